@@ -0,0 +1,34 @@
+#include "arena.h"
+
+
+CountingResource::CountingResource(std::pmr::memory_resource *upstream) : upstream(upstream) {}
+
+
+size_t CountingResource::get_allocated() const {
+    return allocated;
+}
+
+
+size_t CountingResource::get_blocks() const {
+    return blocks;
+}
+
+
+void * CountingResource::do_allocate(size_t bytes, size_t alignment) {
+    void *ptr = upstream->allocate(bytes, alignment);
+    allocated += bytes;
+    blocks++;
+    return ptr;
+}
+
+
+void CountingResource::do_deallocate(void *ptr, size_t bytes, size_t alignment) {
+    upstream->deallocate(ptr, bytes, alignment);
+    allocated -= bytes;
+    blocks--;
+}
+
+
+bool CountingResource::do_is_equal(const std::pmr::memory_resource &other) const noexcept {
+    return this == &other;
+}
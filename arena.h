@@ -0,0 +1,24 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <memory_resource>
+
+
+// Upstream of the per-file arena, counts what the arena takes from the heap.
+class CountingResource : public std::pmr::memory_resource {
+public:
+    explicit CountingResource(std::pmr::memory_resource *upstream = std::pmr::new_delete_resource());
+    size_t get_allocated() const;
+    size_t get_blocks() const;
+private:
+    void * do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void *ptr, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+
+    std::pmr::memory_resource *upstream;
+    size_t allocated = 0;
+    size_t blocks = 0;
+};
+
+#endif
@@ -0,0 +1,185 @@
+#ifdef DISASM_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef DISASM_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+#include "compress.h"
+
+
+BlockCompressor::BlockCompressor(FILE *file, Compression compression, unsigned threads)
+    : file(file), compression(compression), threads(threads == 0 ? 1 : threads) {
+    current.reserve(COMPRESS_BLOCK_SIZE);
+    for (unsigned i = 0; i < this->threads; i++) {
+        workers.emplace_back(&BlockCompressor::compress_blocks, this);
+    }
+}
+
+
+BlockCompressor::~BlockCompressor() {
+    stop();
+}
+
+
+void BlockCompressor::write(const char *data, size_t size) {
+    current.append(data, size);
+    if (current.size() >= COMPRESS_BLOCK_SIZE) {
+        submit();
+        // Bounds memory: wait for the oldest block once enough are in flight
+        write_completed(2 * threads);
+    }
+}
+
+
+bool BlockCompressor::finish() {
+    if (!current.empty()) {
+        submit();
+    }
+    write_completed(0);
+    stop();
+    return !error;
+}
+
+
+void BlockCompressor::submit() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.emplace_back();
+        jobs.back().block = std::move(current);
+    }
+    job_ready.notify_one();
+    current.clear();
+    current.reserve(COMPRESS_BLOCK_SIZE);
+}
+
+
+void BlockCompressor::write_completed(size_t max_pending) {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!jobs.empty()) {
+        if (!jobs.front().done) {
+            if (jobs.size() <= max_pending) {
+                break;
+            }
+            job_done.wait(lock, [this] { return jobs.front().done; });
+        }
+        CompressJob job = std::move(jobs.front());
+        jobs.pop_front();
+        next_job--;
+        lock.unlock();
+        if (!job.ok || fwrite(job.compressed.data(), 1, job.compressed.size(), file) != job.compressed.size()) {
+            error = true;
+        }
+        lock.lock();
+    }
+}
+
+
+void BlockCompressor::compress_blocks() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        job_ready.wait(lock, [this] { return stopping || next_job < jobs.size(); });
+        if (next_job == jobs.size()) {
+            return;
+        }
+        // Other elements stay in place while the deque grows or shrinks at the ends
+        CompressJob &job = jobs[next_job++];
+        lock.unlock();
+        bool ok = compress_block(job.block, job.compressed);
+        lock.lock();
+        job.ok = ok;
+        job.done = true;
+        job_done.notify_all();
+    }
+}
+
+
+void BlockCompressor::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    job_ready.notify_all();
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+}
+
+
+bool BlockCompressor::compress_block(const std::string &block, std::string &dest) {
+    switch (compression) {
+#ifdef DISASM_WITH_ZLIB
+        case Compression::GZIP:
+        {
+            z_stream stream{};
+            // 15 window bits + 16 for the gzip wrapper
+            if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                return false;
+            }
+            dest.resize(deflateBound(&stream, block.size()));
+            stream.next_in = (Bytef *) block.data();
+            stream.avail_in = block.size();
+            stream.next_out = (Bytef *) &dest[0];
+            stream.avail_out = dest.size();
+            int result = deflate(&stream, Z_FINISH);
+            dest.resize(stream.total_out);
+            deflateEnd(&stream);
+            return result == Z_STREAM_END;
+        }
+#endif
+#ifdef DISASM_WITH_ZSTD
+        case Compression::ZSTD:
+        {
+            dest.resize(ZSTD_compressBound(block.size()));
+            size_t size = ZSTD_compress(&dest[0], dest.size(), block.data(), block.size(), 3);
+            if (ZSTD_isError(size)) {
+                return false;
+            }
+            dest.resize(size);
+            return true;
+        }
+#endif
+        case Compression::NONE:
+            dest = block;
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+bool is_compression_supported(Compression compression) {
+    switch (compression) {
+        case Compression::NONE:
+            return true;
+        case Compression::GZIP:
+#ifdef DISASM_WITH_ZLIB
+            return true;
+#else
+            return false;
+#endif
+        case Compression::ZSTD:
+#ifdef DISASM_WITH_ZSTD
+            return true;
+#else
+            return false;
+#endif
+        default:
+            return false;
+    }
+}
+
+
+const char * get_compression_name(Compression compression) {
+    switch (compression) {
+        case Compression::NONE:
+            return "none";
+        case Compression::GZIP:
+            return "gzip";
+        case Compression::ZSTD:
+            return "zstd";
+        default:
+            return nullptr;
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define COMPRESS_BLOCK_SIZE (1 << 20)
+
+
+enum class Compression {
+    NONE,
+    GZIP,
+    ZSTD,
+};
+
+
+struct CompressJob {
+    std::string block;
+    std::string compressed;
+    bool ok = false;
+    bool done = false;
+};
+
+
+// Splits the output into blocks and compresses every block into a separate
+// gzip member (or zstd frame) on a pool of worker threads. Concatenated
+// members form a valid stream, so the file can be read by the ordinary
+// zcat/zstdcat. The caller only hands blocks over and writes the finished
+// ones in order, so compression overlaps with producing the next blocks.
+class BlockCompressor {
+public:
+    BlockCompressor(FILE *file, Compression compression, unsigned threads);
+    BlockCompressor(const BlockCompressor &) = delete;
+    BlockCompressor & operator=(const BlockCompressor &) = delete;
+    ~BlockCompressor();
+    void write(const char *data, size_t size);
+    bool finish();
+private:
+    void submit();
+    void write_completed(size_t max_pending);
+    void compress_blocks();
+    void stop();
+    bool compress_block(const std::string &block, std::string &dest);
+
+    FILE *file;
+    Compression compression;
+    unsigned threads;
+    std::string current;
+    // Blocks in output order, jobs[next_job] is the first one no worker took
+    std::deque<CompressJob> jobs;
+    size_t next_job = 0;
+    std::mutex mutex;
+    std::condition_variable job_ready;
+    std::condition_variable job_done;
+    bool stopping = false;
+    bool error = false;
+    std::vector<std::thread> workers;
+};
+
+bool is_compression_supported(Compression compression);
+
+const char * get_compression_name(Compression compression);
+
+#endif
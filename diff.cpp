@@ -0,0 +1,80 @@
+#include <algorithm>
+#include <cstring>
+
+#include "diff.h"
+
+#define FNV_OFFSET 0xcbf29ce484222325ull
+#define FNV_PRIME 0x100000001b3ull
+
+
+uint64_t hash_words(const char *code, Elf32_Word size) {
+    uint64_t hash = FNV_OFFSET;
+    for (Elf32_Word i = 0; i < size; i += 4) {
+        uint32_t word;
+        memcpy(&word, code + i, sizeof(word));
+        hash = (hash ^ word) * FNV_PRIME;
+    }
+    return hash;
+}
+
+
+void diff_lines(const std::vector<std::string> &old_lines, const std::vector<std::string> &new_lines, std::vector<DiffLine> &script) {
+    size_t prefix = 0;
+    while (prefix < old_lines.size() && prefix < new_lines.size() && old_lines[prefix] == new_lines[prefix]) {
+        prefix++;
+    }
+    size_t suffix = 0;
+    while (suffix < old_lines.size() - prefix && suffix < new_lines.size() - prefix && old_lines[old_lines.size() - 1 - suffix] == new_lines[new_lines.size() - 1 - suffix]) {
+        suffix++;
+    }
+    for (size_t i = 0; i < prefix; i++) {
+        script.push_back({DIFF_KEEP, i});
+    }
+    size_t old_count = old_lines.size() - prefix - suffix;
+    size_t new_count = new_lines.size() - prefix - suffix;
+    if (old_count * new_count > DIFF_MAX_CELLS) {
+        for (size_t i = 0; i < old_count; i++) {
+            script.push_back({DIFF_REMOVE, prefix + i});
+        }
+        for (size_t i = 0; i < new_count; i++) {
+            script.push_back({DIFF_ADD, prefix + i});
+        }
+    }
+    else {
+        // lengths[i][j] is the LCS of the middles from old i and new j on
+        std::vector<uint32_t> lengths((old_count + 1) * (new_count + 1), 0);
+        auto length = [&](size_t i, size_t j) -> uint32_t & {
+            return lengths[i * (new_count + 1) + j];
+        };
+        for (size_t i = old_count; i-- > 0;) {
+            for (size_t j = new_count; j-- > 0;) {
+                if (old_lines[prefix + i] == new_lines[prefix + j]) {
+                    length(i, j) = length(i + 1, j + 1) + 1;
+                }
+                else {
+                    length(i, j) = std::max(length(i + 1, j), length(i, j + 1));
+                }
+            }
+        }
+        size_t i = 0;
+        size_t j = 0;
+        while (i < old_count || j < new_count) {
+            if (i < old_count && j < new_count && old_lines[prefix + i] == new_lines[prefix + j]) {
+                script.push_back({DIFF_KEEP, prefix + i});
+                i++;
+                j++;
+            }
+            else if (j == new_count || (i < old_count && length(i + 1, j) >= length(i, j + 1))) {
+                script.push_back({DIFF_REMOVE, prefix + i});
+                i++;
+            }
+            else {
+                script.push_back({DIFF_ADD, prefix + j});
+                j++;
+            }
+        }
+    }
+    for (size_t i = old_lines.size() - suffix; i < old_lines.size(); i++) {
+        script.push_back({DIFF_KEEP, i});
+    }
+}
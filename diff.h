@@ -0,0 +1,42 @@
+#ifndef DIFF_H
+#define DIFF_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "elfutil.h"
+
+// Largest trimmed old x new size diffed with LCS, beyond that the
+// differing middle is reported as replaced
+#define DIFF_MAX_CELLS (4u * 1024 * 1024)
+
+#define DIFF_KEEP ' '
+#define DIFF_REMOVE '-'
+#define DIFF_ADD '+'
+
+
+struct DiffFunction {
+    const char *name;
+    Elf32_Addr addr;
+    Elf32_Word size;
+    const char *code;
+};
+
+
+struct DiffLine {
+    char op;
+    // Index into the old lines for DIFF_KEEP and DIFF_REMOVE, else the new
+    size_t index;
+};
+
+
+// FNV-1a over 32-bit words, size is a multiple of 4
+uint64_t hash_words(const char *code, Elf32_Word size);
+
+// Edit script turning old_lines into new_lines: the common prefix and
+// suffix are trimmed and the rest is aligned by longest common subsequence.
+void diff_lines(const std::vector<std::string> &old_lines, const std::vector<std::string> &new_lines, std::vector<DiffLine> &script);
+
+#endif
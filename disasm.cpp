@@ -3,158 +3,175 @@
 #include <vector>
 #include <cstring>
 #include <string>
-#include <sstream>
 #include <unordered_map>
 #include <cstdio>
 #include <cstdarg>
 #include <cstdlib>
 #include <cerrno>
 #include <algorithm>
+#include <atomic>
+#include <thread>
+#include <cxxabi.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "disasm.h"
 #include "riscvutil.h"
 #include "elfutil.h"
 
 
-template <class T>
-static std::string to_hex(T value)
-{
-    std::ostringstream stream;
-    stream << "0x" << std::hex << value;
-    return stream.str();
+Disasm::Disasm(const DisasmOptions &options) : options(options) {}
+
+
+Disasm::~Disasm() {
+    if (elf_ptr != nullptr) {
+        munmap(elf_ptr, elf_size);
+    }
 }
 
 
-long Disasm::get_file_offset(const char *ptr) {
+long Disasm::get_file_offset(const char *ptr) const {
     return ptr - elf_ptr;
 }
 
 
-bool Disasm::in_file(const char *ptr, long size) {
+bool Disasm::in_file(const char *ptr, long size) const {
     long offset = get_file_offset(ptr);
-    return offset >= 0 && offset + size <= elf_file_content.size();
+    return offset >= 0 && offset + size <= elf_size;
 }
 
 
-bool Disasm::has_symtab_label(Elf32_Addr addr) {
+bool Disasm::has_symtab_label(Elf32_Addr addr) const {
     return symtab_labels.find(addr) != symtab_labels.end();
 }
 
 
-bool Disasm::has_l_label(Elf32_Addr addr) {
+bool Disasm::has_l_label(Elf32_Addr addr) const {
     return l_labels.find(addr) != l_labels.end();
 }
 
 
-bool Disasm::has_label(Elf32_Addr addr) {
+bool Disasm::has_label(Elf32_Addr addr) const {
     return has_symtab_label(addr) || has_l_label(addr);
 }
 
 
-void Disasm::print_unknown(Elf32_Addr addr, Instruction instruction) {
-    print("   %05x:\t%08x\tunknown_instruction\n", addr, instruction);
+void Disasm::print_unknown(PrintContext &context, Elf32_Addr addr, Instruction instruction) const {
+    // Not part of the base ISA, give the enabled extensions a try
+    char operands[64];
+    const char *cmd = !has_reserved_rounding_mode(instruction) ? decode_extension(instruction, extensions, operands, sizeof(operands)) : nullptr;
+    if (cmd != nullptr) {
+        print(context, "   %05x:\t%08x\t%7s\t%s", addr, instruction, cmd, operands);
+    }
+    else {
+        print(context, "   %05x:\t%08x\tunknown_instruction", addr, instruction);
+    }
 }
 
 
-void Disasm::print_r(Elf32_Addr addr, Instruction instruction) {
+void Disasm::print_r(PrintContext &context, Elf32_Addr addr, Instruction instruction) const {
     const char * const cmd = get_r_cmd(get_funct7(instruction), get_funct3(instruction));
     if (cmd == nullptr) {
-        print_unknown(addr, instruction);
+        print_unknown(context, addr, instruction);
     }
     else {
-        print("   %05x:\t%08x\t%7s\t%s, %s, %s\n", addr, instruction, cmd, get_reg_name(get_rd(instruction)), get_reg_name(get_rs1(instruction)), get_reg_name(get_rs2(instruction)));
+        print(context, "   %05x:\t%08x\t%7s\t%s, %s, %s", addr, instruction, cmd, get_reg_name(get_rd(instruction)), get_reg_name(get_rs1(instruction)), get_reg_name(get_rs2(instruction)));
     }
 }
 
 
-void Disasm::Disasm::print_s(Elf32_Addr addr, Instruction instruction) {
+void Disasm::print_s(PrintContext &context, Elf32_Addr addr, Instruction instruction) const {
     const char * cmd = get_s_cmd(get_funct3(instruction));
     if (cmd == nullptr) {
-        print_unknown(addr, instruction);
+        print_unknown(context, addr, instruction);
     }
     else {
-        std::string immediate = std::to_string(get_s_immediate(instruction));
-        print("   %05x:\t%08x\t%7s\t%s, %s(%s)\n", addr, instruction, cmd, get_reg_name(get_rs2(instruction)), immediate.c_str(), get_reg_name(get_rs1(instruction)));
+        print(context, "   %05x:\t%08x\t%7s\t%s, %d(%s)", addr, instruction, cmd, get_reg_name(get_rs2(instruction)), get_s_immediate(instruction), get_reg_name(get_rs1(instruction)));
     }
 }
 
 
-void Disasm::print_u(Elf32_Addr addr, Instruction instruction, Opcode opcode) {
+void Disasm::print_u(PrintContext &context, Elf32_Addr addr, Instruction instruction, Opcode opcode) const {
     const char * const cmd = get_u_cmd(opcode);
-    std::string immediate = std::to_string(get_u_immediate(instruction));
-    print("   %05x:\t%08x\t%7s\t%s, %s\n", addr, instruction, cmd, get_reg_name(get_rd(instruction)), immediate.c_str());
+    print(context, "   %05x:\t%08x\t%7s\t%s, %d", addr, instruction, cmd, get_reg_name(get_rd(instruction)), get_u_immediate(instruction));
 }
 
 
-void Disasm::print_i(Elf32_Addr addr, Instruction instruction, Opcode opcode) {
+void Disasm::print_i(PrintContext &context, Elf32_Addr addr, Instruction instruction, Opcode opcode) const {
     Funct3 funct3 = get_funct3(instruction);
     const char * cmd;
-    std::string arg;
+    Immediate arg;
     if (is_i_shift(funct3, opcode)) {
         cmd = get_shift_cmd(get_shift_type(instruction), funct3);
-        arg = std::to_string(get_shamt(instruction));
+        arg = get_shamt(instruction);
     }
     else {
         cmd = get_i_cmd(funct3, opcode);
-        arg = std::to_string(get_i_immediate(instruction));
+        arg = get_i_immediate(instruction);
     }
     if (cmd == nullptr) {
-        print_unknown(addr, instruction);
+        print_unknown(context, addr, instruction);
     } else {
-        print("   %05x:\t%08x\t%7s\t%s, %s, %s\n", addr, instruction, cmd, get_reg_name(get_rd(instruction)), get_reg_name(get_rs1(instruction)), arg.c_str());
+        print(context, "   %05x:\t%08x\t%7s\t%s, %s, %d", addr, instruction, cmd, get_reg_name(get_rd(instruction)), get_reg_name(get_rs1(instruction)), arg);
     }
 }
 
 
-void Disasm::print_load_jalr(Elf32_Addr addr, Instruction instruction, Opcode opcode) {
+void Disasm::print_load_jalr(PrintContext &context, Elf32_Addr addr, Instruction instruction, Opcode opcode) const {
     const char * cmd = get_load_jalr_cmd(get_funct3(instruction), opcode);
     if (cmd == nullptr) {
-        print_unknown(addr, instruction);
+        print_unknown(context, addr, instruction);
     }
     else {
-        std::string immediate = std::to_string(get_i_immediate(instruction));
-        print("   %05x:\t%08x\t%7s\t%s, %s(%s)\n", addr, instruction, cmd, get_reg_name(get_rd(instruction)), immediate.c_str(), get_reg_name(get_rs1(instruction)));
+        print(context, "   %05x:\t%08x\t%7s\t%s, %d(%s)", addr, instruction, cmd, get_reg_name(get_rd(instruction)), get_i_immediate(instruction), get_reg_name(get_rs1(instruction)));
     }
 }
 
 
-std::string Disasm::get_label(Elf32_Addr addr) {
-    std::string label;
-    if (has_symtab_label(addr)) {
-        label = symtab_labels[addr];
+const char * Disasm::get_label(Elf32_Addr addr) const {
+    auto symtab_label = symtab_labels.find(addr);
+    if (symtab_label != symtab_labels.end()) {
+        return symtab_label->second;
     }
-    else {
-        label = "L" + std::to_string(l_labels[addr]);
-    }
-    return label;
+    auto l_label = l_labels.find(addr);
+    return l_label != l_labels.end() ? l_label->second : "";
 }
 
 
-std::string Disasm::format_target(Elf32_Addr addr, Immediate immediate) {
+const char * Disasm::format_target(PrintContext &context, Elf32_Addr addr, Immediate immediate) const {
     Elf32_Addr target = addr + immediate;
-    return to_hex(target) + " <" + get_label(target) + ">";
+    char symbol[SYMBOL_BUFFER_SIZE];
+    if (options.symbol_offsets && !has_symtab_label(target) && format_symbol(target, symbol, sizeof(symbol))) {
+        snprintf(context.target_buffer, sizeof(context.target_buffer), "0x%x %s", target, symbol);
+    }
+    else {
+        snprintf(context.target_buffer, sizeof(context.target_buffer), "0x%x <%s>", target, get_label(target));
+    }
+    return context.target_buffer;
 }
 
 
-void Disasm::print_j(Elf32_Addr addr, Instruction instruction) {
-    std::string target = format_target(addr, get_j_immediate(instruction));
-    print("   %05x:\t%08x\t%7s\t%s, %s\n", addr, instruction, "jal", get_reg_name(get_rd(instruction)), target.c_str());
+void Disasm::print_j(PrintContext &context, Elf32_Addr addr, Instruction instruction) const {
+    const char *target = format_target(context, addr, get_j_immediate(instruction));
+    print(context, "   %05x:\t%08x\t%7s\t%s, %s", addr, instruction, "jal", get_reg_name(get_rd(instruction)), target);
 }
 
 
-void Disasm::print_b(Elf32_Addr addr, Instruction instruction) {
+void Disasm::print_b(PrintContext &context, Elf32_Addr addr, Instruction instruction) const {
     const char * cmd = get_b_cmd(get_funct3(instruction));
     if (cmd == nullptr) {
-        print_unknown(addr, instruction);
+        print_unknown(context, addr, instruction);
     }
     else {
-        std::string target = format_target(addr, get_b_immediate(instruction));
-        print("   %05x:\t%08x\t%7s\t%s, %s, %s\n", addr, instruction, cmd, get_reg_name(get_rs1(instruction)), get_reg_name(get_rs2(instruction)), target.c_str());
+        const char *target = format_target(context, addr, get_b_immediate(instruction));
+        print(context, "   %05x:\t%08x\t%7s\t%s, %s, %s", addr, instruction, cmd, get_reg_name(get_rs1(instruction)), get_reg_name(get_rs2(instruction)), target);
     }
 }
 
 
-const char * Disasm::get_system_cmd(Instruction instruction) {
+const char * Disasm::get_system_cmd(Instruction instruction) const {
     if (get_funct3(instruction) == PRIV && get_rd(instruction) == 0 && get_rs1(instruction) == 0) {
         switch (get_funct12(instruction)) {
             case ECALL:
@@ -169,13 +186,13 @@ const char * Disasm::get_system_cmd(Instruction instruction) {
 }
 
 
-void Disasm::print_system(Elf32_Addr addr, Instruction instruction) {
+void Disasm::print_system(PrintContext &context, Elf32_Addr addr, Instruction instruction) const {
     const char * cmd = get_system_cmd(instruction);
     if (cmd == nullptr) {
-        print_unknown(addr, instruction);
+        print_unknown(context, addr, instruction);
     }
     else {
-        print("   %05x:\t%08x\t%7s\n", addr, instruction, cmd);
+        print(context, "   %05x:\t%08x\t%7s", addr, instruction, cmd);
     }
 }
 
@@ -192,49 +209,502 @@ void Disasm::extract_l_label(Elf32_Addr addr, Instruction instruction) {
         return;
     }
     Elf32_Addr target = addr + immediate;
-    if (!has_label(target) && !has_l_label(target)) {
-        l_labels[target] = l_labels.size();
+    if (!has_label(target)) {
+        char *label = (char *) arena.allocate(L_LABEL_SIZE, 1);
+        snprintf(label, L_LABEL_SIZE, "L%zu", l_labels.size());
+        l_labels[target] = label;
+    }
+}
+
+
+void Disasm::print_instruction(PrintContext &context, Elf32_Addr addr, Instruction instruction) const {
+    Opcode opcode = instruction & 0b1111111;
+    switch (opcode) {
+        case LOAD:
+        case JALR:
+            print_load_jalr(context, addr, instruction, opcode);
+            break;
+        case LUI:
+        case AUIPC:
+            print_u(context, addr, instruction, opcode);
+            break;
+        case JAL:
+            print_j(context, addr, instruction);
+            break;
+        case OP_IMM:
+            print_i(context, addr, instruction, opcode);
+            break;
+        case BRANCH:
+            print_b(context, addr, instruction);
+            break;
+        case STORE:
+            print_s(context, addr, instruction);
+            break;
+        case OP:
+            print_r(context, addr, instruction);
+            break;
+        case SYSTEM:
+            print_system(context, addr, instruction);
+            break;
+        default:
+            print_unknown(context, addr, instruction);
+            break;
     }
 }
 
 
-void Disasm::print_instruction(Elf32_Addr addr, Instruction instruction) {
+const char * Disasm::get_cmd(Instruction instruction, InstructionFormat &format) const {
     Opcode opcode = instruction & 0b1111111;
+    const char *cmd;
     switch (opcode) {
         case LOAD:
         case JALR:
-            print_load_jalr(addr, instruction, opcode);
+            format = FORMAT_I;
+            cmd = get_load_jalr_cmd(get_funct3(instruction), opcode);
             break;
         case LUI:
         case AUIPC:
-            print_u(addr, instruction, opcode);
+            format = FORMAT_U;
+            cmd = get_u_cmd(opcode);
             break;
         case JAL:
-            print_j(addr, instruction);
+            format = FORMAT_J;
+            cmd = "jal";
             break;
         case OP_IMM:
-            print_i(addr, instruction, opcode);
+        {
+            format = FORMAT_I;
+            Funct3 funct3 = get_funct3(instruction);
+            if (is_i_shift(funct3, opcode)) {
+                cmd = get_shift_cmd(get_shift_type(instruction), funct3);
+            }
+            else {
+                cmd = get_i_cmd(funct3, opcode);
+            }
             break;
+        }
         case BRANCH:
-            print_b(addr, instruction);
+            format = FORMAT_B;
+            cmd = get_b_cmd(get_funct3(instruction));
             break;
         case STORE:
-            print_s(addr, instruction);
+            format = FORMAT_S;
+            cmd = get_s_cmd(get_funct3(instruction));
             break;
         case OP:
-            print_r(addr, instruction);
+            format = FORMAT_R;
+            cmd = get_r_cmd(get_funct7(instruction), get_funct3(instruction));
             break;
         case SYSTEM:
-            print_system(addr, instruction);
+            format = FORMAT_I;
+            cmd = get_system_cmd(instruction);
             break;
         default:
-            print_unknown(addr, instruction);
+            cmd = nullptr;
             break;
     }
+    if (cmd == nullptr) {
+        char operands[64];
+        cmd = !has_reserved_rounding_mode(instruction) ? decode_extension(instruction, extensions, operands, sizeof(operands)) : nullptr;
+        if (cmd == nullptr) {
+            format = FORMAT_UNKNOWN;
+        }
+        else if (opcode == STORE_FP) {
+            format = FORMAT_S;
+        }
+        else if (opcode == LOAD_FP || opcode == SYSTEM || opcode == OP_IMM) {
+            format = FORMAT_I;
+        }
+        else {
+            format = FORMAT_R;
+        }
+    }
+    return cmd;
 }
 
 
-void Disasm::report_error(const char *format, ...) {
+void Disasm::count_range(Histogram &histogram, Elf32_Word begin, Elf32_Word end, const std::vector<SymbolRange> &functions) const {
+    histogram.functions.assign(functions.size(), 0);
+    Elf32_Addr text_begin = header->e_entry;
+    auto function = std::upper_bound(functions.begin(), functions.end(), text_begin + begin, [](Elf32_Addr addr, const SymbolRange &range) {
+        return addr < range.value;
+    });
+    if (function != functions.begin()) {
+        function--;
+    }
+    for (Elf32_Word i = begin; i < end; i += ILEN_BYTE) {
+        Instruction instruction = *((Instruction *) (elf_ptr + text->sh_offset + i));
+        histogram.slots[get_mnemonic_slot(instruction)]++;
+        Elf32_Addr addr = text_begin + i;
+        while (function != functions.end() && function->value + function->size <= addr) {
+            function++;
+        }
+        if (function != functions.end() && function->value <= addr) {
+            histogram.functions[function - functions.begin()]++;
+        }
+    }
+    histogram.total += (end - begin) / ILEN_BYTE;
+}
+
+
+void Disasm::print_histogram(PrintContext &context) const {
+    std::vector<SymbolRange> functions;
+    for (Elf32_Word i = 0; i < get_symbol_count(); i++) {
+        Elf32_Sym *sym = get_symbol(i);
+        if (ELF32_ST_TYPE(sym->st_info) == STT_FUNC && sym->st_size != 0) {
+            functions.push_back({sym->st_value, sym->st_size, symbol_names[i]});
+        }
+    }
+    for (size_t i = 0; i < function_starts.size(); i++) {
+        functions.push_back({function_starts[i], get_function_size(i), symtab_labels.at(function_starts[i])});
+    }
+    std::stable_sort(functions.begin(), functions.end(), [](const SymbolRange &a, const SymbolRange &b) {
+        return a.value < b.value;
+    });
+    unsigned threads = options.threads != 0 ? options.threads : std::thread::hardware_concurrency();
+    Elf32_Word count = text->sh_size / ILEN_BYTE;
+    threads = std::max(1u, std::min<unsigned>(threads, count / 4096 + 1));
+    std::vector<Histogram> histograms(threads);
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < threads; i++) {
+        Elf32_Word begin = (Elf32_Word) ((uint64_t) count * i / threads) * ILEN_BYTE;
+        Elf32_Word end = (Elf32_Word) ((uint64_t) count * (i + 1) / threads) * ILEN_BYTE;
+        workers.emplace_back(&Disasm::count_range, this, std::ref(histograms[i]), begin, end, std::cref(functions));
+    }
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    Histogram &histogram = histograms[0];
+    for (unsigned i = 1; i < threads; i++) {
+        histogram.merge(histograms[i]);
+    }
+    // Every slot stands for one mnemonic, so each is decoded once here
+    uint64_t formats[FORMAT_COUNT] = {};
+    uint64_t branches = 0;
+    std::unordered_map<const char *, uint64_t> mnemonic_counts;
+    for_each_mnemonic_slot([&](uint32_t slot, Instruction instruction) {
+        uint64_t count = histogram.slots[slot];
+        if (count == 0) {
+            return;
+        }
+        InstructionFormat format;
+        const char *cmd = get_cmd(instruction, format);
+        formats[format] += count;
+        if (cmd != nullptr) {
+            mnemonic_counts[cmd] += count;
+        }
+        if (format == FORMAT_B || format == FORMAT_J || (instruction & 0b1111111) == JALR) {
+            branches += count;
+        }
+    });
+    uint64_t total = std::max<uint64_t>(histogram.total, 1);
+    print(context, ".histogram\n");
+    print(context, "Instructions: %llu\n", (unsigned long long) histogram.total);
+    print(context, "Unknown: %llu (%.2f%%)\n", (unsigned long long) formats[FORMAT_UNKNOWN], 100.0 * formats[FORMAT_UNKNOWN] / total);
+    print(context, "Branches: %llu (%.2f%%)\n", (unsigned long long) branches, 100.0 * branches / total);
+    print(context, "\nFormat\tCount\n");
+    for (int i = 0; i < FORMAT_COUNT; i++) {
+        print(context, "%s\t%llu\n", get_format_name((InstructionFormat) i), (unsigned long long) formats[i]);
+    }
+    std::vector<std::pair<const char *, uint64_t>> mnemonics(mnemonic_counts.begin(), mnemonic_counts.end());
+    std::sort(mnemonics.begin(), mnemonics.end(), [](const std::pair<const char *, uint64_t> &a, const std::pair<const char *, uint64_t> &b) {
+        return a.second != b.second ? a.second > b.second : strcmp(a.first, b.first) < 0;
+    });
+    print(context, "\nMnemonic\tCount\n");
+    for (const auto &mnemonic : mnemonics) {
+        print(context, "%s\t%llu\n", mnemonic.first, (unsigned long long) mnemonic.second);
+    }
+    print(context, "\nFunction\tCount\n");
+    for (size_t i = 0; i < functions.size(); i++) {
+        print(context, "%s\t%llu\n", functions[i].name, (unsigned long long) histogram.functions[i]);
+    }
+}
+
+
+void Disasm::print_matches(PrintContext &context) const {
+    const char *code = elf_ptr + text->sh_offset;
+    std::vector<Elf32_Word> candidates;
+    pattern.scan(code, text->sh_size, candidates);
+    print(context, ".find %s\n", options.find);
+    size_t count = 0;
+    for (Elf32_Word index : candidates) {
+        Instruction instruction = *((Instruction *) (code + index * ILEN_BYTE));
+        InstructionFormat format;
+        const char *cmd = get_cmd(instruction, format);
+        if (!pattern.matches(instruction, cmd, format)) {
+            continue;
+        }
+        Elf32_Addr addr = header->e_entry + index * ILEN_BYTE;
+        print_instruction(context, addr, instruction);
+        char symbol[SYMBOL_BUFFER_SIZE];
+        if (format_symbol(addr, symbol, sizeof(symbol))) {
+            print(context, "\t%s", symbol);
+        }
+        print(context, "\n");
+        count++;
+    }
+    print(context, "\n%zu matches\n", count);
+}
+
+
+void Disasm::collect_diff_functions(std::vector<DiffFunction> &functions) const {
+    for (Elf32_Word i = 0; i < get_symbol_count(); i++) {
+        Elf32_Sym *sym = get_symbol(i);
+        if (ELF32_ST_TYPE(sym->st_info) != STT_FUNC || sym->st_size == 0 || sym->st_shndx == SHN_UNDEF) {
+            continue;
+        }
+        Elf32_Word offset = sym->st_value - header->e_entry;
+        Elf32_Word size = sym->st_size / ILEN_BYTE * ILEN_BYTE;
+        if (sym->st_value < header->e_entry || offset > text->sh_size || size > text->sh_size - offset) {
+            continue;
+        }
+        functions.push_back({symbol_names[i], sym->st_value, size, elf_ptr + text->sh_offset + offset});
+    }
+    for (size_t i = 0; i < function_starts.size(); i++) {
+        Elf32_Addr addr = function_starts[i];
+        functions.push_back({symtab_labels.at(addr), addr, get_function_size(i), elf_ptr + text->sh_offset + (addr - header->e_entry)});
+    }
+}
+
+
+void Disasm::decode_normalized(const DiffFunction &function, std::vector<std::string> &lines) const {
+    // The immediates of a lui/auipc pair depend on where code and data ended
+    // up. Pairs found by the --annotate tracking drop them: the lui/auipc keeps
+    // only its register and the instruction completing the pair names the
+    // address they add up to.
+    size_t count = function.size / ILEN_BYTE;
+    std::vector<Elf32_Addr> pair_targets(count);
+    std::vector<uint8_t> completes_pair(count, 0);
+    std::vector<uint8_t> starts_pair(count, 0);
+    PrintContext context;
+    reset_constants(context);
+    // Index of the lui/auipc each register's constant came from
+    int32_t sources[32];
+    std::fill(sources, sources + 32, -1);
+    for (size_t index = 0; index < count; index++) {
+        Instruction instruction = *((Instruction *) (function.code + index * ILEN_BYTE));
+        Opcode opcode = instruction & 0b1111111;
+        Register rd = get_rd(instruction);
+        Register rs1 = get_rs1(instruction);
+        int32_t source = sources[rs1];
+        Elf32_Addr target;
+        if (find_constant_target(context, function.addr + index * ILEN_BYTE, instruction, false, target) && rs1 != REG_ZERO) {
+            pair_targets[index] = target;
+            completes_pair[index] = 1;
+            if (source >= 0) {
+                starts_pair[source] = 1;
+            }
+        }
+        if (opcode == LUI || opcode == AUIPC) {
+            sources[rd] = index;
+        }
+        else if (opcode != STORE && rd != REG_ZERO) {
+            sources[rd] = opcode == OP_IMM && get_funct3(instruction) == 0b000 ? source : -1;
+        }
+    }
+    // Targets move with the code: name them relative to this function or by
+    // symbol instead of objdump's absolute address. Data is named after the
+    // object holding it before any label sharing its address.
+    auto name_target = [&](Elf32_Addr target, bool is_data, char *buffer, size_t size) {
+        auto label = symtab_labels.find(target);
+        if (target >= function.addr && target < function.addr + function.size) {
+            snprintf(buffer, size, ".+0x%x", target - function.addr);
+        }
+        else if (is_data && format_symbol(target, buffer, size)) {
+            return;
+        }
+        else if (label != symtab_labels.end() && label->second[0] != '\0') {
+            snprintf(buffer, size, "<%s>", label->second);
+        }
+        else if (!format_symbol(target, buffer, size)) {
+            snprintf(buffer, size, "0x%x", target);
+        }
+    };
+    ObjdumpInstruction decoded;
+    char line[SYMBOL_BUFFER_SIZE + 96];
+    char target[SYMBOL_BUFFER_SIZE];
+    for (size_t index = 0; index < count; index++) {
+        Instruction instruction = *((Instruction *) (function.code + index * ILEN_BYTE));
+        Opcode opcode = instruction & 0b1111111;
+        const char *rd = get_reg_name(get_rd(instruction));
+        const char *rs1 = get_reg_name(get_rs1(instruction));
+        if (!decode_objdump(function.addr + index * ILEN_BYTE, instruction, extensions, decoded)) {
+            snprintf(line, sizeof(line), ".insn\t0x%08x", instruction);
+        }
+        else if (decoded.has_target) {
+            char *last = strrchr(decoded.operands, ',');
+            *(last != nullptr ? last : decoded.operands) = '\0';
+            name_target(decoded.target, false, target, sizeof(target));
+            snprintf(line, sizeof(line), "%s\t%s%s%s", decoded.cmd, decoded.operands, decoded.operands[0] != '\0' ? "," : "", target);
+        }
+        else if (starts_pair[index]) {
+            snprintf(line, sizeof(line), "%s\t%s,%%hi", decoded.cmd, rd);
+        }
+        else if (completes_pair[index]) {
+            name_target(pair_targets[index], opcode != JALR, target, sizeof(target));
+            if (opcode == OP_IMM) {
+                snprintf(line, sizeof(line), "addi\t%s,%s,%s", rd, rs1, target);
+            }
+            else if (opcode == STORE) {
+                snprintf(line, sizeof(line), "%s\t%s,%s(%s)", decoded.cmd, get_reg_name(get_rs2(instruction)), target, rs1);
+            }
+            else {
+                snprintf(line, sizeof(line), "%s\t%s,%s(%s)", decoded.cmd, rd, target, rs1);
+            }
+        }
+        else {
+            snprintf(line, sizeof(line), "%s\t%s", decoded.cmd, decoded.operands);
+        }
+        lines.emplace_back(line);
+    }
+}
+
+
+std::string Disasm::diff_function(const Disasm &old_image, const DiffFunction &old_function, const DiffFunction &new_function) const {
+    std::vector<std::string> old_lines;
+    std::vector<std::string> new_lines;
+    old_image.decode_normalized(old_function, old_lines);
+    decode_normalized(new_function, new_lines);
+    std::vector<DiffLine> script;
+    diff_lines(old_lines, new_lines, script);
+    std::string result;
+    char line[SYMBOL_BUFFER_SIZE + 128];
+    for (const DiffLine &diff_line : script) {
+        if (diff_line.op == DIFF_KEEP) {
+            continue;
+        }
+        const std::vector<std::string> &lines = diff_line.op == DIFF_REMOVE ? old_lines : new_lines;
+        snprintf(line, sizeof(line), "%c\t+0x%zx\t%s\n", diff_line.op, diff_line.index * ILEN_BYTE, lines[diff_line.index].c_str());
+        result += line;
+    }
+    if (!result.empty()) {
+        snprintf(line, sizeof(line), "\n@@ %s old 0x%x (%u bytes) new 0x%x (%u bytes)\n", new_function.name, old_function.addr, old_function.size, new_function.addr, new_function.size);
+        result.insert(0, line);
+    }
+    return result;
+}
+
+
+void Disasm::print_diff(PrintContext &context, const Disasm &old_image, const char *input_file_name) const {
+    std::vector<DiffFunction> old_functions;
+    std::vector<DiffFunction> new_functions;
+    old_image.collect_diff_functions(old_functions);
+    collect_diff_functions(new_functions);
+    std::unordered_map<std::string_view, size_t> old_names;
+    for (size_t i = 0; i < old_functions.size(); i++) {
+        old_names.emplace(old_functions[i].name, i);
+    }
+    std::vector<std::pair<size_t, size_t>> pairs;
+    std::vector<bool> matched(old_functions.size(), false);
+    std::vector<size_t> added;
+    for (size_t i = 0; i < new_functions.size(); i++) {
+        auto old_function = old_names.find(new_functions[i].name);
+        if (old_function != old_names.end() && !matched[old_function->second]) {
+            matched[old_function->second] = true;
+            pairs.emplace_back(old_function->second, i);
+        }
+        else {
+            added.push_back(i);
+        }
+    }
+    // Words are compared by hash first, a hit is confirmed byte by byte; only
+    // functions that differ get decoded, an empty result then means the code
+    // only moved
+    std::vector<uint8_t> identical(pairs.size(), 0);
+    std::vector<std::string> results(pairs.size());
+    std::atomic<size_t> next{0};
+    auto compare = [&]() {
+        for (size_t i = next++; i < pairs.size(); i = next++) {
+            const DiffFunction &old_function = old_functions[pairs[i].first];
+            const DiffFunction &new_function = new_functions[pairs[i].second];
+            if (old_function.size == new_function.size && hash_words(old_function.code, old_function.size) == hash_words(new_function.code, new_function.size)
+                    && memcmp(old_function.code, new_function.code, new_function.size) == 0) {
+                identical[i] = 1;
+            }
+            else {
+                results[i] = diff_function(old_image, old_function, new_function);
+            }
+        }
+    };
+    unsigned threads = options.threads != 0 ? options.threads : std::thread::hardware_concurrency();
+    threads = std::max(1u, std::min<unsigned>(threads, pairs.size() / 16 + 1));
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < threads; i++) {
+        workers.emplace_back(compare);
+    }
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    print(context, ".diff %s %s\n", options.diff, input_file_name);
+    size_t changed = 0;
+    size_t moved = 0;
+    for (size_t i = 0; i < pairs.size(); i++) {
+        if (!results[i].empty()) {
+            write(context, results[i].data(), results[i].size());
+            changed++;
+        }
+        else if (!identical[i]) {
+            moved++;
+        }
+    }
+    print(context, "\n");
+    for (size_t i = 0; i < old_functions.size(); i++) {
+        if (!matched[i]) {
+            print(context, "Removed: %s\n", old_functions[i].name);
+        }
+    }
+    for (size_t i : added) {
+        print(context, "Added: %s\n", new_functions[i].name);
+    }
+    print(context, "Functions: %zu changed, %zu moved, %zu identical, %zu added, %zu removed\n", changed, moved, pairs.size() - changed - moved, added.size(), old_functions.size() - pairs.size());
+}
+
+
+void Disasm::write(PrintContext &context, const char *data, size_t size) const {
+    if (context.pipeline != nullptr) {
+        context.pipeline->write(data, size);
+    }
+    else if (fwrite(data, 1, size, context.output_file) != size) {
+        context.write_error = -1;
+    }
+}
+
+
+void Disasm::print_section(PrintContext &context, const char *name, Elf32_Shdr *section) const {
+    print(context, "\n%s\n", name);
+    const unsigned char *data = (const unsigned char *) elf_ptr + section->sh_offset;
+    char rows[HEX_ROW_SIZE * 64];
+    size_t used = 0;
+    for (Elf32_Word i = 0; i < section->sh_size; i += HEX_ROW_BYTES) {
+        format_hex_row(section->sh_addr + i, data + i, std::min<Elf32_Word>(HEX_ROW_BYTES, section->sh_size - i), rows + used);
+        used += HEX_ROW_SIZE;
+        if (used == sizeof(rows)) {
+            write(context, rows, used);
+            used = 0;
+        }
+    }
+    write(context, rows, used);
+}
+
+
+void Disasm::print_sections(PrintContext &context) const {
+    Elf32_Shdr *section_names_strtab = (Elf32_Shdr *) (elf_ptr + header->e_shoff + header->e_shstrndx * header->e_shentsize);
+    const char *section_names_ptr = elf_ptr + section_names_strtab->sh_offset;
+    for (Elf32_Half i = 0; i < header->e_shnum; i++) {
+        Elf32_Shdr *section = (Elf32_Shdr *) (elf_ptr + header->e_shoff + i * header->e_shentsize);
+        if (!(section->sh_flags & SHF_ALLOC) || (section->sh_flags & SHF_EXECINSTR) || section->sh_type == SHT_NOBITS || section->sh_size == 0) {
+            continue;
+        }
+        if (!in_file(elf_ptr + section->sh_offset, section->sh_size)) {
+            report_error("Section %d beyond file boundaries", i);
+            continue;
+        }
+        print_section(context, section_names_ptr + section->sh_name, section);
+    }
+}
+
+
+void Disasm::report_error(const char *format, ...) const {
     fprintf(stderr, "Error. ");
     va_list ptr;
     va_start(ptr, format);
@@ -244,40 +714,120 @@ void Disasm::report_error(const char *format, ...) {
 }
 
 
-void Disasm::print(const char *format, ...) {
+void Disasm::print(PrintContext &context, const char *format, ...) const {
     va_list ptr;
     va_start(ptr, format);
-    write_error = std::min(write_error, vfprintf(output_file, format, ptr));
+    if (context.pipeline != nullptr) {
+        context.pipeline->vprint(format, ptr);
+    }
+    else {
+        context.write_error = std::min(context.write_error, vfprintf(context.output_file, format, ptr));
+    }
     va_end(ptr);
 }
 
 
-bool Disasm::read_input_file(std::vector<char> &dest, const char *input_file_name) {
-    FILE *elf_file = fopen(input_file_name, "rb");
-    if (elf_file == NULL) {
+bool Disasm::read_input_file(const char *input_file_name) {
+    int elf_file = open(input_file_name, O_RDONLY);
+    if (elf_file == -1) {
         perror("Error. Couldn't open input file");
         return false;
     }
-    fseek(elf_file, 0, SEEK_END);
-    long length = ftell(elf_file);
-    dest.resize(length);
-    fseek(elf_file, 0, SEEK_SET);
-    fread(&dest[0], length, 1, elf_file);
-    if (fclose(elf_file) != 0) {
-        perror("Error. Couldn't close input file");
+    struct stat elf_stat;
+    if (fstat(elf_file, &elf_stat) != 0) {
+        perror("Error. Couldn't stat input file");
+        close(elf_file);
         return false;
     }
-    if (length == 0) {
+    if (elf_stat.st_size == 0) {
+        close(elf_file);
         report_error("Input file is empty");
         return false;
     }
+    void *mapping = mmap(nullptr, elf_stat.st_size, PROT_READ, MAP_PRIVATE, elf_file, 0);
+    if (close(elf_file) != 0) {
+        perror("Error. Couldn't close input file");
+    }
+    if (mapping == MAP_FAILED) {
+        perror("Error. Couldn't map input file");
+        return false;
+    }
+    // Let the kernel read the file ahead while the headers are being parsed
+    madvise(mapping, elf_stat.st_size, MADV_WILLNEED);
+    elf_ptr = (char *) mapping;
+    elf_size = elf_stat.st_size;
     return true;
 }
 
 
 void Disasm::collect_l_labels() {
+    l_labels.reserve(text->sh_size / ILEN_BYTE / 8);
     for (Elf32_Word i = 0; i < text->sh_size; i += ILEN_BYTE) {
-        extract_l_label(header->e_entry + i, *((Instruction *) (elf_ptr + text->sh_offset + i)));
+        Instruction instruction = *((Instruction *) (elf_ptr + text->sh_offset + i));
+        extract_l_label(header->e_entry + i, instruction);
+        if (options.stack) {
+            stack_analysis.visit(header->e_entry + i, instruction);
+        }
+    }
+}
+
+
+void Disasm::collect_functions() {
+    for (Elf32_Word i = 0; i < get_symbol_count(); i++) {
+        Elf32_Sym *sym = get_symbol(i);
+        if (ELF32_ST_TYPE(sym->st_info) == STT_FUNC && sym->st_size != 0) {
+            stack_analysis.add_function(sym->st_value, sym->st_size, symbol_names[i]);
+        }
+    }
+    for (size_t i = 0; i < function_starts.size(); i++) {
+        stack_analysis.add_function(function_starts[i], get_function_size(i), symtab_labels[function_starts[i]]);
+    }
+    stack_analysis.start();
+}
+
+
+void Disasm::print_stack(PrintContext &context) const {
+    print(context, "\n.stack\n");
+    print(context, "%-24s %8s %5s %5s %12s\n", "Function", "Frame", "Leaf", "Entry", "Max stack");
+    for (size_t i = 0; i < stack_analysis.size(); i++) {
+        char depth[16];
+        uint32_t max_depth = stack_analysis.get_max_depth(i);
+        if (max_depth == STACK_UNBOUNDED) {
+            snprintf(depth, sizeof(depth), "recursive");
+        }
+        else {
+            // '+' marks a lower bound: some callee is reached through jalr
+            snprintf(depth, sizeof(depth), "%u%s", max_depth, stack_analysis.has_indirect_calls(i) ? "+" : "");
+        }
+        print(context, "%-24s %8u %5s %5s %12s\n", stack_analysis.get_name(i), stack_analysis.get_frame(i), stack_analysis.is_leaf(i) ? "yes" : "no", stack_analysis.is_entry(i) ? "yes" : "no", depth);
+    }
+}
+
+
+void Disasm::collect_reachable_l_labels() {
+    const char *code = elf_ptr + text->sh_offset;
+    traversal.reset(new Traversal(code, header->e_entry, text->sh_size, [this](Instruction instruction) {
+        InstructionFormat format;
+        return get_cmd(instruction, format) != nullptr;
+    }));
+    std::vector<Elf32_Addr> seeds = {header->e_entry};
+    for (Elf32_Word i = 0; i < get_symbol_count(); i++) {
+        Elf32_Sym *sym = get_symbol(i);
+        if (ELF32_ST_TYPE(sym->st_info) == STT_FUNC) {
+            seeds.push_back(sym->st_value);
+        }
+    }
+    seeds.insert(seeds.end(), function_starts.begin(), function_starts.end());
+    unsigned threads = options.threads != 0 ? options.threads : std::thread::hardware_concurrency();
+    traversal->run(seeds, threads);
+    l_labels.reserve(text->sh_size / ILEN_BYTE / 8);
+    for (Elf32_Word i = 0; i < text->sh_size; i += ILEN_BYTE) {
+        if (traversal->is_reachable(header->e_entry + i)) {
+            extract_l_label(header->e_entry + i, *((Instruction *) (code + i)));
+            if (options.stack) {
+                stack_analysis.visit(header->e_entry + i, *((Instruction *) (code + i)));
+            }
+        }
     }
 }
 
@@ -300,14 +850,42 @@ bool Disasm::process_section_header_table() {
             case SHT_PROGBITS:
             {
                 const char *section_name = section_names_ptr + section->sh_name;
-                if (elf_file_content.size() - get_file_offset(section_name) > 5 && strcmp(section_name, ".text") == 0) {
+                size_t max_length = elf_size - get_file_offset(section_name);
+                if (max_length > 5 && strcmp(section_name, ".text") == 0) {
                     text = section;
                 }
+                else if (max_length > 15 && strcmp(section_name, ".debug_line_str") == 0) {
+                    debug_line_str = section;
+                }
+                else if (max_length > 11 && strcmp(section_name, ".debug_line") == 0) {
+                    debug_line = section;
+                }
+                else if (max_length > 14 && strcmp(section_name, ".debug_aranges") == 0) {
+                    debug_aranges = section;
+                }
+                else if (max_length > 11 && strcmp(section_name, ".debug_info") == 0) {
+                    debug_info = section;
+                }
+                else if (max_length > 13 && strcmp(section_name, ".debug_abbrev") == 0) {
+                    debug_abbrev = section;
+                }
+                else if (max_length > 10 && strcmp(section_name, ".debug_str") == 0) {
+                    debug_str = section;
+                }
+                else if (max_length > 13 && strcmp(section_name, ".debug_ranges") == 0) {
+                    debug_ranges = section;
+                }
+                else if (max_length > 15 && strcmp(section_name, ".debug_rnglists") == 0) {
+                    debug_rnglists = section;
+                }
                 break;
             }
             case SHT_SYMTAB:
                 symtab = section;
                 break;
+            case SHT_RISCV_ATTRIBUTES:
+                attributes = section;
+                break;
         }
     }
     if (text == nullptr) {
@@ -317,62 +895,524 @@ bool Disasm::process_section_header_table() {
     if (!check_text()) {
         return false;
     }
-    else if (symtab == nullptr) {
-        report_error(".symtab not found");
-        return false;
+    // A stripped image gets its labels from discover_functions instead
+    if (symtab != nullptr) {
+        char *strtab_ptr = elf_ptr + header->e_shoff + symtab->sh_link * header->e_shentsize;
+        if (!in_file(strtab_ptr, sizeof(Elf32_Shdr))) {
+            report_error("No .strtab");
+            return false;
+        }
+        strtab = (Elf32_Shdr *) (strtab_ptr);
     }
-    char *strtab_ptr = elf_ptr + header->e_shoff + symtab->sh_link * header->e_shentsize;
-    if (!in_file(strtab_ptr, sizeof(Elf32_Shdr))) {
-        report_error("No .strtab");
-        return false;
+    if (options.arch != nullptr) {
+        extensions = parse_arch(options.arch);
+    }
+    else if (attributes != nullptr) {
+        extensions = process_attributes();
     }
-    strtab = (Elf32_Shdr *) (strtab_ptr);
     return true;
 }
 
 
+Extensions Disasm::process_attributes() {
+    const unsigned char *ptr = (const unsigned char *) elf_ptr + attributes->sh_offset;
+    if (!in_file((const char *) ptr, attributes->sh_size) || attributes->sh_size == 0 || *ptr != 'A') {
+        return EXT_ALL;
+    }
+    const unsigned char *end = ptr + attributes->sh_size;
+    ptr++;
+    while (end - ptr >= 4) {
+        const unsigned char *subsection = ptr;
+        Elf32_Word length = *((const Elf32_Word *) ptr);
+        if (length < 4 || length > (Elf32_Word) (end - ptr)) {
+            break;
+        }
+        const unsigned char *subsection_end = subsection + length;
+        ptr += 4;
+        const char *vendor = (const char *) ptr;
+        size_t vendor_length = strnlen(vendor, subsection_end - ptr);
+        ptr += vendor_length + 1;
+        if (strcmp(vendor, "riscv") == 0) {
+            while (subsection_end - ptr >= 5) {
+                uint32_t tag = read_uleb128(ptr, subsection_end);
+                if (subsection_end - ptr < 4) {
+                    break;
+                }
+                Elf32_Word size = *((const Elf32_Word *) ptr);
+                ptr += 4;
+                const unsigned char *attribute_end = std::min(subsection_end, ptr + size);
+                if (tag != TAG_FILE) {
+                    ptr = attribute_end;
+                    continue;
+                }
+                while (ptr < attribute_end) {
+                    uint32_t attribute = read_uleb128(ptr, attribute_end);
+                    // odd tags carry strings, even ones integers
+                    if (attribute % 2 == 0) {
+                        read_uleb128(ptr, attribute_end);
+                        continue;
+                    }
+                    const char *value = (const char *) ptr;
+                    size_t value_length = strnlen(value, attribute_end - ptr);
+                    if (value_length == (size_t) (attribute_end - ptr)) {
+                        return EXT_ALL;
+                    }
+                    if (attribute == TAG_RISCV_ARCH) {
+                        return parse_arch(value);
+                    }
+                    ptr += value_length + 1;
+                }
+            }
+        }
+        ptr = subsection_end;
+    }
+    return EXT_ALL;
+}
+
+
+const char * Disasm::demangle(const char *name) {
+    if (strncmp(name, "_Z", 2) != 0) {
+        return name;
+    }
+    auto cached = demangled_names.find(name);
+    if (cached != demangled_names.end()) {
+        return cached->second;
+    }
+    const char *result = name;
+    int status;
+    char *demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    if (status == 0) {
+        size_t size = strlen(demangled) + 1;
+        char *interned = (char *) arena.allocate(size, 1);
+        memcpy(interned, demangled, size);
+        result = interned;
+    }
+    free(demangled);
+    demangled_names.emplace(name, result);
+    return result;
+}
+
+
+Elf32_Word Disasm::get_symbol_count() const {
+    return symtab != nullptr ? symtab->sh_size / symtab->sh_entsize : 0;
+}
+
+
+Elf32_Sym * Disasm::get_symbol(Elf32_Word index) const {
+    return (Elf32_Sym *) (elf_ptr + symtab->sh_offset + index * symtab->sh_entsize);
+}
+
+
 bool Disasm::process_symtab() {
-    for (Elf32_Word i = 0; i < symtab->sh_size / symtab->sh_entsize; i++) {
-        char *sym_ptr = elf_ptr + symtab->sh_offset + i * symtab->sh_entsize;
-        if (!in_file(sym_ptr, sizeof(Elf32_Sym))) {
+    symtab_labels.reserve(get_symbol_count());
+    symbol_names.reserve(get_symbol_count());
+    symbols_by_name.reserve(get_symbol_count());
+    for (Elf32_Word i = 0; i < get_symbol_count(); i++) {
+        Elf32_Sym *sym = get_symbol(i);
+        if (!in_file((char *) sym, sizeof(Elf32_Sym))) {
             report_error("No .symtab entry %d", i);
             return false;
         }
-        Elf32_Sym *sym = (Elf32_Sym *) (sym_ptr);
         long name_offset = strtab->sh_offset + sym->st_name;
         const char *name = elf_ptr + name_offset;
-        long max_length = elf_file_content.size() - name_offset;
+        long max_length = elf_size - name_offset;
         if (strnlen(name, max_length) == max_length) {
             report_error("Invalid .symtab (name of entry %ld not null terminated)");
             return false;
         }
+        // The first symbol of a name wins, under its raw and demangled name
+        const char *demangled = demangle(name);
+        symbols_by_name.emplace(name, sym);
+        symbols_by_name.emplace(demangled, sym);
+        if (options.demangle) {
+            name = demangled;
+        }
+        symbol_names.push_back(name);
         symtab_labels[sym->st_value] = name;
     }
     return true;
 }
 
 
-void Disasm::print_text() {
-    print(".text\n");
-    for (Elf32_Word i = 0; i < text->sh_size; i += ILEN_BYTE) {
-        Elf32_Addr addr = header->e_entry + i;
+void Disasm::discover_functions() {
+    unsigned threads = options.threads != 0 ? options.threads : std::thread::hardware_concurrency();
+    std::vector<Elf32_Addr> starts = find_function_starts(elf_ptr + text->sh_offset, header->e_entry, text->sh_size, threads);
+    function_starts.assign(starts.begin(), starts.end());
+    symtab_labels.reserve(function_starts.size());
+    for (Elf32_Addr addr : function_starts) {
+        char *label = (char *) arena.allocate(FUNCTION_LABEL_SIZE, 1);
+        snprintf(label, FUNCTION_LABEL_SIZE, "func_%x", addr);
+        symtab_labels[addr] = label;
+    }
+}
+
+
+Elf32_Word Disasm::get_function_size(size_t index) const {
+    Elf32_Addr end = index + 1 < function_starts.size() ? function_starts[index + 1] : header->e_entry + text->sh_size;
+    return end - function_starts[index];
+}
+
+
+void Disasm::collect_address_symbols() {
+    std::vector<SymbolRange> ranges;
+    for (Elf32_Word i = 0; i < get_symbol_count(); i++) {
+        Elf32_Sym *sym = get_symbol(i);
+        unsigned char type = ELF32_ST_TYPE(sym->st_info);
+        if ((type == STT_OBJECT || type == STT_FUNC) && sym->st_size != 0 && sym->st_shndx != SHN_UNDEF) {
+            ranges.push_back({sym->st_value, sym->st_size, symbol_names[i]});
+        }
+    }
+    for (size_t i = 0; i < function_starts.size(); i++) {
+        ranges.push_back({function_starts[i], get_function_size(i), symtab_labels.at(function_starts[i])});
+    }
+    address_index.build(std::move(ranges));
+    if (options.objdump) {
+        std::vector<ObjdumpSymbol> symbols;
+        for (Elf32_Word i = 0; i < get_symbol_count(); i++) {
+            Elf32_Sym *sym = get_symbol(i);
+            unsigned char type = ELF32_ST_TYPE(sym->st_info);
+            const char *name = symbol_names[i];
+            // objdump skips section, file and undefined symbols and the $x/$d mapping symbols
+            if (name[0] == '\0' || type == STT_SECTION || type == STT_FILE || sym->st_shndx == SHN_UNDEF || sym->st_shndx == SHN_COMMON
+                    || (name[0] == '$' && (name[1] == 'x' || name[1] == 'd'))) {
+                continue;
+            }
+            symbols.push_back({sym->st_value, sym->st_size, name, sym->st_shndx, sym->st_info});
+        }
+        Elf32_Half text_index = ((char *) text - (elf_ptr + header->e_shoff)) / header->e_shentsize;
+        objdump_symbols.build(std::move(symbols), text_index, text->sh_addr);
+    }
+    Elf32_Sym *global_pointer_sym = find_symbol("__global_pointer$");
+    if (global_pointer_sym != nullptr) {
+        has_global_pointer = true;
+        global_pointer = global_pointer_sym->st_value;
+    }
+}
+
+
+bool Disasm::format_symbol(Elf32_Addr addr, char *buffer, size_t size) const {
+    const SymbolRange *range = address_index.find(addr);
+    if (range == nullptr) {
+        return false;
+    }
+    Elf32_Addr offset = addr - range->value;
+    if (offset == 0) {
+        snprintf(buffer, size, "<%s>", range->name);
+    }
+    else {
+        snprintf(buffer, size, "<%s+0x%x>", range->name, offset);
+    }
+    return true;
+}
+
+
+void Disasm::reset_constants(PrintContext &context) const {
+    context.known_registers = 1u << REG_ZERO;
+    context.register_values[REG_ZERO] = 0;
+    if (has_global_pointer) {
+        context.known_registers |= 1u << REG_GP;
+        context.register_values[REG_GP] = global_pointer;
+    }
+}
+
+
+// objdump pairs a lui or auipc only with the first addi, load, store or jalr
+// based on its register and otherwise falls back to gp, tp and zero relative
+// addresses; --annotate follows the constants through the basic block.
+bool Disasm::find_constant_target(PrintContext &context, Elf32_Addr addr, Instruction instruction, bool objdump_pairs, Elf32_Addr &target) const {
+    Opcode opcode = instruction & 0b1111111;
+    Register rd = get_rd(instruction);
+    Register rs1 = get_rs1(instruction);
+    bool rs1_known = (context.known_registers >> rs1) & 1;
+    bool has_target = false;
+    bool rd_known = false;
+    Elf32_Addr rd_value = 0;
+    switch (opcode) {
+        case LUI:
+            rd_known = true;
+            rd_value = instruction & 0xfffff000;
+            break;
+        case AUIPC:
+            rd_known = true;
+            rd_value = addr + (instruction & 0xfffff000);
+            break;
+        case OP_IMM:
+            if (objdump_pairs) {
+                // li, mv and nop have no immediate to pair with
+                has_target = get_funct3(instruction) == 0b000 && rs1 != REG_ZERO && get_i_immediate(instruction) != 0;
+                target = get_i_immediate(instruction);
+            }
+            else if (get_funct3(instruction) == 0b000 && rs1_known) {
+                has_target = rd_known = true;
+                target = rd_value = context.register_values[rs1] + get_i_immediate(instruction);
+            }
+            break;
+        case JALR:
+            has_target = objdump_pairs ? get_i_immediate(instruction) != 0 : rs1_known;
+            target = (objdump_pairs ? 0 : context.register_values[rs1]) + get_i_immediate(instruction);
+            break;
+        case LOAD:
+        case LOAD_FP:
+            has_target = objdump_pairs || (opcode == LOAD && rs1_known);
+            target = (objdump_pairs ? 0 : context.register_values[rs1]) + get_i_immediate(instruction);
+            break;
+        case STORE:
+        case STORE_FP:
+            has_target = objdump_pairs || (opcode == STORE && rs1_known);
+            target = (objdump_pairs ? 0 : context.register_values[rs1]) + get_s_immediate(instruction);
+            break;
+    }
+    if (objdump_pairs) {
+        // target holds the offset here
+        if (rd_known && rd != REG_ZERO) {
+            context.known_registers |= 1u << rd;
+            context.register_values[rd] = rd_value;
+        }
+        if (!has_target) {
+            return false;
+        }
+        if (rs1_known) {
+            target += context.register_values[rs1];
+            context.known_registers &= ~(1u << rs1);
+            return true;
+        }
+        if (rs1 == REG_GP && has_global_pointer) {
+            target += global_pointer;
+            return true;
+        }
+        return rs1 == REG_TP || rs1 == REG_ZERO;
+    }
+    if (opcode == JAL || opcode == JALR || opcode == BRANCH) {
+        reset_constants(context);
+    }
+    else if (opcode != STORE && rd != REG_ZERO) {
+        if (rd_known) {
+            context.known_registers |= 1u << rd;
+            context.register_values[rd] = rd_value;
+        }
+        else {
+            context.known_registers &= ~(1u << rd);
+        }
+    }
+    return has_target;
+}
+
+
+void Disasm::annotate_constants(PrintContext &context, Elf32_Addr addr, Instruction instruction) const {
+    Elf32_Addr target;
+    char symbol[SYMBOL_BUFFER_SIZE];
+    if (find_constant_target(context, addr, instruction, false, target) && format_symbol(target, symbol, sizeof(symbol))) {
+        print(context, "\t# 0x%x %s", target, symbol);
+    }
+}
+
+
+void Disasm::print_source_line(PrintContext &context, const LineRow &row) const {
+    const char *directory = line_table.get_directory(row.file);
+    const char *name = line_table.get_file_name(row.file);
+    if (directory != nullptr && name[0] != '/') {
+        print(context, "%s/%s:%u\n", directory, name, row.line);
+    }
+    else {
+        print(context, "%s:%u\n", name, row.line);
+    }
+}
+
+
+bool Disasm::load_profile() {
+    if (!profile.load(options.profile)) {
+        if (profile.get_error_line() != 0) {
+            report_error("Invalid profile line %zu", profile.get_error_line());
+        }
+        return false;
+    }
+    Elf32_Addr text_begin = header->e_entry;
+    Elf32_Addr text_end = header->e_entry + text->sh_size;
+    profile_functions.push_back(text_begin);
+    for (const auto &label : symtab_labels) {
+        if (label.first > text_begin && label.first < text_end) {
+            profile_functions.push_back(label.first);
+        }
+    }
+    std::sort(profile_functions.begin(), profile_functions.end());
+    profile.sum_ranges(profile_functions, text_end, profile_totals);
+    return true;
+}
+
+
+bool Disasm::is_hot_function(size_t function) const {
+    return profile_totals[function] * 100.0 >= options.profile_threshold * profile.get_total();
+}
+
+
+void Disasm::print_profile_count(PrintContext &context, uint64_t count) const {
+    print(context, "\t# %llu %.2f%%", (unsigned long long) count, 100.0 * count / std::max<uint64_t>(profile.get_total(), 1));
+}
+
+
+void Disasm::print_text_range(PrintContext &context, Elf32_Addr begin, Elf32_Addr end) const {
+    Elf32_Addr text_begin = header->e_entry;
+    Elf32_Addr text_end = header->e_entry + text->sh_size;
+    begin = std::max(begin, text_begin);
+    end = std::min(end, text_end);
+    reset_constants(context);
+    std::vector<LineRow> line_rows;
+    size_t line_cursor = 0;
+    uint32_t last_file = LINE_NO_FILE;
+    uint32_t last_line = 0;
+    if (options.lines) {
+        line_table.decode(begin, end, line_rows);
+    }
+    size_t sample_cursor = 0;
+    size_t function_cursor = 0;
+    bool hidden = false;
+    if (options.profile != nullptr) {
+        sample_cursor = profile.find(begin);
+        function_cursor = std::upper_bound(profile_functions.begin(), profile_functions.end(), begin) - profile_functions.begin() - 1;
+        hidden = !is_hot_function(function_cursor);
+    }
+    for (Elf32_Addr addr = begin + (text_begin - begin) % ILEN_BYTE; addr < end; addr += ILEN_BYTE) {
+        uint64_t count = 0;
+        if (options.profile != nullptr) {
+            // Both cursors follow the walk, samples inside an instruction count for it
+            bool function_start = false;
+            while (function_cursor + 1 < profile_functions.size() && profile_functions[function_cursor + 1] <= addr) {
+                function_cursor++;
+                function_start = true;
+            }
+            if (function_start) {
+                hidden = !is_hot_function(function_cursor);
+            }
+            while (sample_cursor < profile.size() && profile.get_sample(sample_cursor).addr < addr + ILEN_BYTE) {
+                count += profile.get_sample(sample_cursor++).count;
+            }
+            if (hidden) {
+                continue;
+            }
+        }
         if (has_label(addr)) {
-            std::string label = get_label(addr);
-            print("%08x   <%s>:\n", addr, label.c_str());
+            print(context, "%08x   <%s>:", addr, get_label(addr));
+            if (options.profile != nullptr && has_symtab_label(addr)) {
+                print_profile_count(context, profile_totals[function_cursor]);
+            }
+            print(context, "\n");
+            reset_constants(context);
         }
-        print_instruction(header->e_entry + i, *((Instruction *) (elf_ptr + text->sh_offset + i)));
+        if (options.lines) {
+            // Rows come in address order, so the cursor only moves forward
+            const LineRow *row = nullptr;
+            while (line_cursor < line_rows.size() && line_rows[line_cursor].addr <= addr) {
+                row = &line_rows[line_cursor++];
+            }
+            if (row != nullptr && row->line != 0 && (row->file != last_file || row->line != last_line)) {
+                print_source_line(context, *row);
+            }
+            if (row != nullptr) {
+                last_file = row->file;
+                last_line = row->line;
+            }
+        }
+        Instruction instruction = *((Instruction *) (elf_ptr + text->sh_offset + (addr - text_begin)));
+        if (traversal != nullptr && !traversal->is_reachable(addr)) {
+            print(context, "   %05x:\t%08x\t%7s\t0x%08x", addr, instruction, ".word", instruction);
+        }
+        else {
+            print_instruction(context, addr, instruction);
+            if (options.annotate) {
+                annotate_constants(context, addr, instruction);
+            }
+        }
+        if (count != 0) {
+            print_profile_count(context, count);
+        }
+        print(context, "\n");
     }
 }
 
 
-void Disasm::print_symtab() {
-    print(".symtab\n");
-    print("Symbol Value          	Size Type 	Bind 	Vis   	Index Name\n");
-    for (Elf32_Word i = 0; i < symtab->sh_size / symtab->sh_entsize; i++) {
-        Elf32_Sym *sym = (Elf32_Sym *) (elf_ptr + symtab->sh_offset + i * symtab->sh_entsize);
+void Disasm::print_objdump_text(PrintContext &context, const char *input_file_name) const {
+    print(context, "\n%s:     file format elf32-littleriscv\n\n\n", input_file_name);
+    print(context, "Disassembly of section .text:\n");
+    Elf32_Addr text_begin = header->e_entry;
+    ObjdumpInstruction decoded;
+    char symbol[SYMBOL_BUFFER_SIZE];
+    // objdump keeps its lui/auipc pairs across the whole section
+    context.known_registers = 0;
+    for (Elf32_Word i = 0; i < text->sh_size; i += ILEN_BYTE) {
+        Elf32_Addr addr = text_begin + i;
+        if (!objdump_symbols.empty()) {
+            const ObjdumpSymbol *label = objdump_symbols.find(addr);
+            if (label != nullptr && label->value == addr) {
+                print(context, "\n%08x <%s>:\n", addr, label->name);
+            }
+        }
+        else {
+            auto label = symtab_labels.find(addr);
+            if (label != symtab_labels.end() && label->second[0] != '\0') {
+                print(context, "\n%08x <%s>:\n", addr, label->second);
+            }
+        }
+        Instruction instruction = *((Instruction *) (elf_ptr + text->sh_offset + i));
+        if (!decode_objdump(addr, instruction, extensions, decoded)) {
+            print(context, "%8x:\t%08x          \t.insn\t4, 0x%08x\n", addr, instruction, instruction);
+            continue;
+        }
+        print(context, "%8x:\t%08x          \t%s", addr, instruction, decoded.cmd);
+        if (decoded.operands[0] != '\0') {
+            print(context, "\t%s", decoded.operands);
+        }
+        if (decoded.has_target) {
+            if (!objdump_symbols.empty()) {
+                objdump_symbols.format(decoded.target, symbol, sizeof(symbol));
+                print(context, " %s", symbol);
+            }
+            else {
+                auto target_label = symtab_labels.find(decoded.target);
+                if (target_label != symtab_labels.end() && target_label->second[0] != '\0') {
+                    print(context, " <%s>", target_label->second);
+                }
+                else if (format_symbol(decoded.target, symbol, sizeof(symbol))) {
+                    print(context, " %s", symbol);
+                }
+            }
+        }
+        Elf32_Addr target;
+        if (find_constant_target(context, addr, instruction, true, target)) {
+            print(context, " # %x", target);
+            if (!objdump_symbols.empty()) {
+                objdump_symbols.format(target, symbol, sizeof(symbol));
+                print(context, " %s", symbol);
+            }
+        }
+        print(context, "\n");
+    }
+}
+
+
+void Disasm::print_text(PrintContext &context) const {
+    print(context, ".text\n");
+    print_text_range(context, header->e_entry, header->e_entry + text->sh_size);
+}
+
+
+void Disasm::print_symtab(PrintContext &context) const {
+    print(context, ".symtab\n");
+    print(context, "Symbol Value          	Size Type 	Bind 	Vis   	Index Name\n");
+    for (Elf32_Word i = 0; i < get_symbol_count(); i++) {
+        Elf32_Sym *sym = get_symbol(i);
         std::string index = get_index(sym->st_shndx);
-        const char * name = elf_ptr + strtab->sh_offset + sym->st_name;
-        print("[%4i] 0x%-15X %5i %-8s %-8s %-8s %6s %s\n", i, sym->st_value, sym->st_size, get_type(sym->st_info), get_bind(sym->st_info), get_vis(sym->st_other), index.c_str(), name);
+        const char * name = symbol_names[i];
+        print(context, "[%4i] 0x%-15X %5i %-8s %-8s %-8s %6s %s\n", i, sym->st_value, sym->st_size, get_type(sym->st_info), get_bind(sym->st_info), get_vis(sym->st_other), index.c_str(), name);
+    }
+    if (symtab == nullptr) {
+        // Synthesized from the discovered function starts
+        Elf32_Half text_index = ((char *) text - (elf_ptr + header->e_shoff)) / header->e_shentsize;
+        std::string index = get_index(text_index);
+        unsigned char info = ELF32_ST_INFO(STB_LOCAL, STT_FUNC);
+        for (size_t i = 0; i < function_starts.size(); i++) {
+            Elf32_Addr addr = function_starts[i];
+            print(context, "[%4zu] 0x%-15X %5i %-8s %-8s %-8s %6s %s\n", i, addr, get_function_size(i), get_type(info), get_bind(info), get_vis(STV_DEFAULT), index.c_str(), symtab_labels.at(addr));
+        }
     }
 }
 
@@ -423,7 +1463,7 @@ bool Disasm::check_text() {
         report_error("Invalid .text size");
         return false;
     }
-    if (text->sh_offset + text->sh_size > elf_file_content.size()) {
+    if (text->sh_offset + text->sh_size > elf_size) {
         report_error("End of .text beyond file boundaries");
         return false;
     }
@@ -431,41 +1471,179 @@ bool Disasm::check_text() {
 }
 
 
-bool Disasm::open_write_file(const char *output_file_name) {
-    output_file = fopen(output_file_name, "wb");
-    if (output_file == NULL) {
+bool Disasm::open_write_file(PrintContext &context, const char *output_file_name) {
+    context.output_file = fopen(output_file_name, "wb");
+    if (context.output_file == NULL) {
         perror("Error. Couldn't open the output file");
         return false;
     }
+    if (options.compression != Compression::NONE) {
+        unsigned threads = options.threads != 0 ? options.threads : std::thread::hardware_concurrency();
+        context.compressor.reset(new BlockCompressor(context.output_file, options.compression, threads));
+    }
+    context.pipeline.reset(new OutputPipeline(context.output_file, context.compressor.get()));
     return true;
 }
 
 
-void Disasm::process(const char *input_file_name, const char *output_file_name) {
-    if (!read_input_file(elf_file_content, input_file_name)) {
-        return;
+bool Disasm::load(const char *input_file_name) {
+    if (!read_input_file(input_file_name)) {
+        return false;
     }
-    elf_ptr = &elf_file_content[0];
     if (!process_header()) {
-        return;
+        return false;
     }
     if (!process_section_header_table()) {
-        return;
+        return false;
     }
-    if (!process_symtab()) {
+    if (symtab == nullptr) {
+        discover_functions();
+    }
+    else if (!process_symtab()) {
+        return false;
+    }
+    if (options.lines && debug_line != nullptr && in_file(elf_ptr + debug_line->sh_offset, debug_line->sh_size)) {
+        auto get_section = [this](const Elf32_Shdr *section, const char *&ptr, size_t &size) {
+            if (section != nullptr && in_file(elf_ptr + section->sh_offset, section->sh_size)) {
+                ptr = elf_ptr + section->sh_offset;
+                size = section->sh_size;
+            }
+        };
+        const char *line_strings = nullptr;
+        size_t line_strings_size = 0;
+        get_section(debug_line_str, line_strings, line_strings_size);
+        line_table.init(elf_ptr + debug_line->sh_offset, debug_line->sh_size, line_strings, line_strings_size);
+        DebugInfoSections sections;
+        get_section(debug_info, sections.info, sections.info_size);
+        get_section(debug_abbrev, sections.abbrev, sections.abbrev_size);
+        get_section(debug_aranges, sections.aranges, sections.aranges_size);
+        get_section(debug_str, sections.strings, sections.strings_size);
+        get_section(debug_ranges, sections.ranges, sections.ranges_size);
+        get_section(debug_rnglists, sections.rnglists, sections.rnglists_size);
+        line_table.init_info(sections);
+    }
+    if (options.profile != nullptr && !load_profile()) {
+        return false;
+    }
+    if (options.find != nullptr) {
+        auto get_cmd = [this](Instruction instruction, InstructionFormat &format) {
+            return this->get_cmd(instruction, format);
+        };
+        if (!pattern.compile(options.find, get_cmd)) {
+            report_error("Invalid pattern \"%s\"", options.find);
+            return false;
+        }
+    }
+    if (options.annotate || options.symbol_offsets || options.objdump || options.find != nullptr || options.diff != nullptr) {
+        collect_address_symbols();
+    }
+    if (options.stack) {
+        collect_functions();
+    }
+    if (options.recursive) {
+        collect_reachable_l_labels();
+    }
+    else if (!options.histogram) {
+        collect_l_labels();
+    }
+    if (options.stack) {
+        stack_analysis.finish(header->e_entry);
+    }
+    return true;
+}
+
+
+Elf32_Sym * Disasm::find_symbol(const char *name) const {
+    auto sym = symbols_by_name.find(name);
+    return sym != symbols_by_name.end() ? sym->second : nullptr;
+}
+
+
+QueryStatus Disasm::print_range(FILE *file, Elf32_Addr begin, Elf32_Addr end) const {
+    PrintContext context;
+    context.output_file = file;
+    print_text_range(context, begin, end);
+    return context.write_error == 0 ? QueryStatus::OK : QueryStatus::WRITE_ERROR;
+}
+
+
+QueryStatus Disasm::print_function(FILE *file, const char *name) const {
+    Elf32_Sym *sym = find_symbol(name);
+    if (sym == nullptr || ELF32_ST_TYPE(sym->st_info) != STT_FUNC) {
+        return QueryStatus::NOT_FOUND;
+    }
+    return print_range(file, sym->st_value, sym->st_value + sym->st_size);
+}
+
+
+QueryStatus Disasm::print_symbol(FILE *file, const char *name) const {
+    Elf32_Sym *sym = find_symbol(name);
+    if (sym == nullptr) {
+        return QueryStatus::NOT_FOUND;
+    }
+    PrintContext context;
+    context.output_file = file;
+    std::string index = get_index(sym->st_shndx);
+    print(context, "0x%-15X %5i %-8s %-8s %-8s %6s %s\n", sym->st_value, sym->st_size, get_type(sym->st_info), get_bind(sym->st_info), get_vis(sym->st_other), index.c_str(), name);
+    return context.write_error == 0 ? QueryStatus::OK : QueryStatus::WRITE_ERROR;
+}
+
+
+void Disasm::process(const char *input_file_name, const char *output_file_name) {
+    if (!load(input_file_name)) {
         return;
     }
-    collect_l_labels();
-    if (!open_write_file(output_file_name)) {
+    std::unique_ptr<Disasm> old_image;
+    if (options.diff != nullptr) {
+        old_image.reset(new Disasm(options));
+        if (!old_image->load(options.diff)) {
+            return;
+        }
+    }
+    PrintContext context;
+    if (!open_write_file(context, output_file_name)) {
         return;
     }
-    print_text();
-    print("\n");
-    print_symtab();
-    if (write_error != 0) {
+    if (options.histogram) {
+        print_histogram(context);
+    }
+    else if (options.objdump) {
+        print_objdump_text(context, input_file_name);
+    }
+    else if (options.find != nullptr) {
+        print_matches(context);
+    }
+    else if (options.diff != nullptr) {
+        print_diff(context, *old_image, input_file_name);
+    }
+    else {
+        print_text(context);
+        print(context, "\n");
+        print_symtab(context);
+        if (options.stack) {
+            print_stack(context);
+        }
+        if (options.dump_sections) {
+            print_sections(context);
+        }
+    }
+    if (!context.pipeline->finish()) {
+        context.write_error = -1;
+    }
+    if (context.write_error != 0) {
         report_error("Errors occurred while writing to the output file, the output file is incorrect");
     }
-    if (fclose(output_file) != 0) {
+    if (fclose(context.output_file) != 0) {
         perror("Error. Couldn't close the output file");
     }
+    if (options.memory_report) {
+        print_memory_report();
+    }
+}
+
+
+void Disasm::print_memory_report() {
+    fprintf(stderr, "Input: %zu bytes mapped\n", elf_size);
+    fprintf(stderr, "Arena: %zu bytes in %zu blocks\n", arena_upstream.get_allocated(), arena_upstream.get_blocks());
+    fprintf(stderr, "Labels: %zu symtab, %zu L\n", symtab_labels.size(), l_labels.size());
 }
@@ -1,58 +1,201 @@
 #ifndef DISASM_H
 #define DISASM_H
 
+#include <memory>
+#include <memory_resource>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
 #include "riscvutil.h"
+#include "riscvext.h"
 #include "elfutil.h"
+#include "compress.h"
+#include "arena.h"
+#include "histogram.h"
+#include "traversal.h"
+#include "pipeline.h"
+#include "symindex.h"
+#include "hexdump.h"
+#include "objdump.h"
+#include "stack.h"
+#include "discover.h"
+#include "lines.h"
+#include "pattern.h"
+#include "profile.h"
+#include "diff.h"
+
+#define L_LABEL_SIZE 12
+#define SYMBOL_BUFFER_SIZE 256
+
+
+struct DisasmOptions {
+    Compression compression = Compression::NONE;
+    unsigned threads = 0;
+    bool memory_report = false;
+    bool histogram = false;
+    bool recursive = false;
+    bool demangle = false;
+    bool annotate = false;
+    bool symbol_offsets = false;
+    const char *arch = nullptr;
+    bool dump_sections = false;
+    bool objdump = false;
+    bool stack = false;
+    bool lines = false;
+    const char *find = nullptr;
+    const char *profile = nullptr;
+    // Percent of all samples a function needs to be listed with --profile
+    double profile_threshold = 0;
+    // Old image compared against the input with --diff
+    const char *diff = nullptr;
+};
+
+
+enum class QueryStatus {
+    OK,
+    NOT_FOUND,
+    WRITE_ERROR,
+};
+
+
+// State of one print call. Kept outside Disasm so a loaded image is only
+// read while printing and can serve several queries at once.
+struct PrintContext {
+    FILE *output_file = nullptr;
+    int write_error = 0;
+    std::unique_ptr<BlockCompressor> compressor;
+    std::unique_ptr<OutputPipeline> pipeline;
+    char target_buffer[SYMBOL_BUFFER_SIZE + 16];
+    // Registers holding a known constant within the current basic block
+    uint32_t known_registers = 0;
+    Elf32_Addr register_values[32];
+};
 
 
 class Disasm {
 public:
+    explicit Disasm(const DisasmOptions &options = DisasmOptions{});
+    Disasm(const Disasm &) = delete;
+    Disasm & operator=(const Disasm &) = delete;
+    ~Disasm();
     void process(const char *input_file_name, const char *output_file_name);
+    bool load(const char *input_file_name);
+    QueryStatus print_range(FILE *file, Elf32_Addr begin, Elf32_Addr end) const;
+    QueryStatus print_function(FILE *file, const char *name) const;
+    QueryStatus print_symbol(FILE *file, const char *name) const;
 private:
-    long get_file_offset(const char *ptr);
-    bool in_file(const char *ptr, long size);
-    bool has_symtab_label(Elf32_Addr addr); 
-    bool has_l_label(Elf32_Addr addr); 
-    bool has_label(Elf32_Addr addr); 
-    void print_unknown(Elf32_Addr addr, Instruction instruction); 
-    void print_r(Elf32_Addr addr, Instruction instruction); 
-    void print_s(Elf32_Addr addr, Instruction instruction); 
-    void print_u(Elf32_Addr addr, Instruction instruction, Opcode opcode); 
-    void print_i(Elf32_Addr addr, Instruction instruction, Opcode opcode); 
-    void print_load_jalr(Elf32_Addr addr, Instruction instruction, Opcode opcode); 
-    std::string get_label(Elf32_Addr addr);
-    std::string format_target(Elf32_Addr addr, Immediate immediate); 
-    void print_j(Elf32_Addr addr, Instruction instruction); 
-    void print_b(Elf32_Addr addr, Instruction instruction); 
-    const char * get_system_cmd(Instruction instruction); 
-    void print_system(Elf32_Addr addr, Instruction instruction); 
+    long get_file_offset(const char *ptr) const;
+    bool in_file(const char *ptr, long size) const;
+    bool has_symtab_label(Elf32_Addr addr) const;
+    bool has_l_label(Elf32_Addr addr) const;
+    bool has_label(Elf32_Addr addr) const;
+    void print_unknown(PrintContext &context, Elf32_Addr addr, Instruction instruction) const;
+    void print_r(PrintContext &context, Elf32_Addr addr, Instruction instruction) const;
+    void print_s(PrintContext &context, Elf32_Addr addr, Instruction instruction) const;
+    void print_u(PrintContext &context, Elf32_Addr addr, Instruction instruction, Opcode opcode) const;
+    void print_i(PrintContext &context, Elf32_Addr addr, Instruction instruction, Opcode opcode) const;
+    void print_load_jalr(PrintContext &context, Elf32_Addr addr, Instruction instruction, Opcode opcode) const;
+    const char * get_label(Elf32_Addr addr) const;
+    const char * format_target(PrintContext &context, Elf32_Addr addr, Immediate immediate) const;
+    void print_j(PrintContext &context, Elf32_Addr addr, Instruction instruction) const;
+    void print_b(PrintContext &context, Elf32_Addr addr, Instruction instruction) const;
+    const char * get_system_cmd(Instruction instruction) const;
+    void print_system(PrintContext &context, Elf32_Addr addr, Instruction instruction) const;
     void extract_l_label(Elf32_Addr addr, Instruction instruction);
-    void print_instruction(Elf32_Addr addr, Instruction instruction); 
-    void print(const char *format, ...);
-    void report_error(const char *format, ...);
-    bool read_input_file(std::vector<char> &dest, const char *input_file_name);
+    void print_instruction(PrintContext &context, Elf32_Addr addr, Instruction instruction) const;
+    const char * get_cmd(Instruction instruction, InstructionFormat &format) const;
+    void count_range(Histogram &histogram, Elf32_Word begin, Elf32_Word end, const std::vector<SymbolRange> &functions) const;
+    void print_histogram(PrintContext &context) const;
+    void print_matches(PrintContext &context) const;
+    void collect_diff_functions(std::vector<DiffFunction> &functions) const;
+    void decode_normalized(const DiffFunction &function, std::vector<std::string> &lines) const;
+    std::string diff_function(const Disasm &old_image, const DiffFunction &old_function, const DiffFunction &new_function) const;
+    void print_diff(PrintContext &context, const Disasm &old_image, const char *input_file_name) const;
+    void print(PrintContext &context, const char *format, ...) const;
+    void write(PrintContext &context, const char *data, size_t size) const;
+    void print_section(PrintContext &context, const char *name, Elf32_Shdr *section) const;
+    void print_sections(PrintContext &context) const;
+    void report_error(const char *format, ...) const;
+    bool read_input_file(const char *input_file_name);
+    Elf32_Sym * find_symbol(const char *name) const;
     void collect_l_labels();
+    void collect_reachable_l_labels();
+    void collect_functions();
+    void print_stack(PrintContext &context) const;
     bool process_section_header_table();
+    Extensions process_attributes();
+    const char * demangle(const char *name);
+    Elf32_Word get_symbol_count() const;
+    Elf32_Sym * get_symbol(Elf32_Word index) const;
     bool process_symtab();
-    void print_text();
-    void print_symtab();
+    void discover_functions();
+    Elf32_Word get_function_size(size_t index) const;
+    void collect_address_symbols();
+    bool format_symbol(Elf32_Addr addr, char *buffer, size_t size) const;
+    void reset_constants(PrintContext &context) const;
+    bool find_constant_target(PrintContext &context, Elf32_Addr addr, Instruction instruction, bool objdump_pairs, Elf32_Addr &target) const;
+    void annotate_constants(PrintContext &context, Elf32_Addr addr, Instruction instruction) const;
+    void print_source_line(PrintContext &context, const LineRow &row) const;
+    bool load_profile();
+    bool is_hot_function(size_t function) const;
+    void print_profile_count(PrintContext &context, uint64_t count) const;
+    void print_text_range(PrintContext &context, Elf32_Addr begin, Elf32_Addr end) const;
+    void print_objdump_text(PrintContext &context, const char *input_file_name) const;
+    void print_text(PrintContext &context) const;
+    void print_symtab(PrintContext &context) const;
     bool process_header();
     bool check_text();
-    bool open_write_file(const char *output_file_name);
+    bool open_write_file(PrintContext &context, const char *output_file_name);
+    void print_memory_report();
 
-    std::vector<char> elf_file_content;
-    std::unordered_map<Elf32_Addr, const char *> symtab_labels;
-    std::unordered_map<Elf32_Addr, Elf32_Addr> l_labels;
+    // Label tables and interned label names live in the per-file arena and
+    // are released all at once together with the Disasm object.
+    CountingResource arena_upstream;
+    std::pmr::monotonic_buffer_resource arena{64 * 1024, &arena_upstream};
+    std::pmr::unordered_map<Elf32_Addr, const char *> symtab_labels{&arena};
+    std::pmr::unordered_map<Elf32_Addr, const char *> l_labels{&arena};
+    // Filled once by process_symtab and only read afterwards, so workers
+    // printing in parallel can share it without locking.
+    std::pmr::unordered_map<std::string_view, const char *> demangled_names{&arena};
+    std::pmr::vector<const char *> symbol_names{&arena};
+    // Raw and demangled names of .symtab entries, for queries by name
+    std::pmr::unordered_map<std::string_view, Elf32_Sym *> symbols_by_name{&arena};
+    // Function starts found by discover_functions when there is no .symtab
+    std::pmr::vector<Elf32_Addr> function_starts{&arena};
+    // Sized OBJECT and FUNC symbols or discovered functions, for <symbol+offset>
+    SymbolIndex address_index;
+    // Every named symbol, for --objdump
+    ObjdumpSymbols objdump_symbols;
+    bool has_global_pointer = false;
+    Elf32_Addr global_pointer = 0;
+    StackAnalysis stack_analysis;
+    // Decoded lazily by print_text_range, one range at a time
+    mutable LineTable line_table;
+    InstructionPattern pattern;
+    Profile profile;
+    // Label addresses in .text plus its start, with the samples of each
+    // up to the next one
+    std::vector<Elf32_Addr> profile_functions;
+    std::vector<uint64_t> profile_totals;
     Elf32_Shdr *text = nullptr;
     Elf32_Shdr *symtab = nullptr;
-    Elf32_Shdr *strtab;
-    char *elf_ptr;
+    Elf32_Shdr *strtab = nullptr;
+    Elf32_Shdr *attributes = nullptr;
+    Elf32_Shdr *debug_line = nullptr;
+    Elf32_Shdr *debug_line_str = nullptr;
+    Elf32_Shdr *debug_aranges = nullptr;
+    Elf32_Shdr *debug_info = nullptr;
+    Elf32_Shdr *debug_abbrev = nullptr;
+    Elf32_Shdr *debug_str = nullptr;
+    Elf32_Shdr *debug_ranges = nullptr;
+    Elf32_Shdr *debug_rnglists = nullptr;
+    Extensions extensions = EXT_ALL;
+    char *elf_ptr = nullptr;
+    size_t elf_size = 0;
     Elf32_Ehdr *header;
-    FILE *output_file;
-    int write_error = 0;
+    DisasmOptions options;
+    std::unique_ptr<Traversal> traversal;
 };
 
 #endif
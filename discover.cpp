@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <thread>
+
+#include "discover.h"
+
+#define WORD_CALL 0x1
+#define WORD_JUMP 0x2
+#define WORD_PROLOGUE 0x4
+#define WORD_SAVE_RA 0x8
+#define WORD_RET 0x10
+#define WORD_PAD 0x20
+
+#define MARK_CALLED 0x1
+#define MARK_JUMPED 0x2
+
+
+struct ChunkTargets {
+    std::vector<Elf32_Word> calls;
+    std::vector<Elf32_Word> jumps;
+};
+
+
+// Branch-free so the compiler can vectorize it
+static void classify(const Instruction *words, uint8_t *flags, Elf32_Word begin, Elf32_Word end) {
+    for (Elf32_Word i = begin; i < end; i++) {
+        Instruction word = words[i];
+        flags[i] = ((word & 0xfff) == 0x0ef) * WORD_CALL                     // jal ra, target
+                | ((word & 0xfff) == 0x06f) * WORD_JUMP                      // jal zero, target
+                | ((word & 0x7f) == BRANCH) * WORD_JUMP
+                | ((word & 0x800fffff) == 0x80010113) * WORD_PROLOGUE        // addi sp, sp, -N
+                | ((word & 0x01fff07f) == 0x00112023) * WORD_SAVE_RA         // sw ra, N(sp)
+                | (word == 0x00008067) * WORD_RET                            // jalr zero, 0(ra)
+                | (word == 0x00000013 || word == 0) * WORD_PAD;              // nop
+    }
+}
+
+
+static void scan_chunk(const Instruction *words, Elf32_Word count, uint8_t *flags, Elf32_Word begin, Elf32_Word end, ChunkTargets &targets) {
+    classify(words, flags, begin, end);
+    for (Elf32_Word i = begin; i < end; i++) {
+        if (!(flags[i] & (WORD_CALL | WORD_JUMP))) {
+            continue;
+        }
+        Immediate immediate = (flags[i] & WORD_CALL) || (words[i] & 0x7f) == JAL ? get_j_immediate(words[i]) : get_b_immediate(words[i]);
+        Elf32_Word target = i + immediate / ILEN_BYTE;
+        if (immediate % ILEN_BYTE != 0 || target >= count) {
+            continue;
+        }
+        if (flags[i] & WORD_CALL) {
+            targets.calls.push_back(target);
+        }
+        else {
+            targets.jumps.push_back(target);
+        }
+    }
+}
+
+
+std::vector<Elf32_Addr> find_function_starts(const char *code, Elf32_Addr base, Elf32_Word size, unsigned threads) {
+    const Instruction *words = (const Instruction *) code;
+    Elf32_Word count = size / ILEN_BYTE;
+    std::vector<uint8_t> flags(count);
+    threads = std::max(1u, std::min<unsigned>(threads, count / 4096 + 1));
+    std::vector<ChunkTargets> targets(threads);
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < threads; i++) {
+        Elf32_Word begin = (Elf32_Word) ((uint64_t) count * i / threads);
+        Elf32_Word end = (Elf32_Word) ((uint64_t) count * (i + 1) / threads);
+        workers.emplace_back(scan_chunk, words, count, flags.data(), begin, end, std::ref(targets[i]));
+    }
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    std::vector<uint8_t> marks(count);
+    for (const ChunkTargets &chunk : targets) {
+        for (Elf32_Word target : chunk.calls) {
+            marks[target] |= MARK_CALLED;
+        }
+        for (Elf32_Word target : chunk.jumps) {
+            marks[target] |= MARK_JUMPED;
+        }
+    }
+    std::vector<Elf32_Addr> starts;
+    bool after_return = false;
+    for (Elf32_Word i = 0; i < count; i++) {
+        // Padding after a return is skipped, but a called nop still starts a function
+        bool pad = flags[i] & WORD_PAD;
+        bool start = i == 0 || (marks[i] & MARK_CALLED) || (!pad && after_return && !(marks[i] & MARK_JUMPED));
+        if (!start && (flags[i] & WORD_PROLOGUE)) {
+            for (Elf32_Word j = i + 1; j < std::min(count, i + 1 + PROLOGUE_WINDOW); j++) {
+                if (flags[j] & WORD_SAVE_RA) {
+                    start = true;
+                    break;
+                }
+            }
+        }
+        if (start) {
+            starts.push_back(base + i * ILEN_BYTE);
+        }
+        if (!pad) {
+            after_return = flags[i] & WORD_RET;
+        }
+    }
+    return starts;
+}
@@ -0,0 +1,21 @@
+#ifndef DISCOVER_H
+#define DISCOVER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "riscvutil.h"
+#include "elfutil.h"
+
+#define FUNCTION_LABEL_SIZE 16
+// How far after addi sp, sp, -N the sw ra, N(sp) of a prologue may be
+#define PROLOGUE_WINDOW 4
+
+
+// Guesses function starts in a .text without a symbol table: the entry point,
+// jal ra targets, addi sp, sp, -N followed by sw ra, and the first instruction
+// after a ret and its padding unless something branches there. Returns the
+// starts in address order.
+std::vector<Elf32_Addr> find_function_starts(const char *code, Elf32_Addr base, Elf32_Word size, unsigned threads);
+
+#endif
@@ -62,3 +62,39 @@ const char * get_bind(unsigned char st_info) {
             return nullptr;
     }
 }
+
+uint32_t read_uleb128(const unsigned char *&ptr, const unsigned char *end) {
+    uint32_t result = 0;
+    int shift = 0;
+    while (ptr < end) {
+        unsigned char byte = *ptr++;
+        if (shift < 32) {
+            result |= (uint32_t) (byte & 0x7f) << shift;
+        }
+        shift += 7;
+        if (!(byte & 0x80)) {
+            break;
+        }
+    }
+    return result;
+}
+
+int32_t read_sleb128(const unsigned char *&ptr, const unsigned char *end) {
+    int32_t result = 0;
+    int shift = 0;
+    unsigned char byte = 0;
+    while (ptr < end) {
+        byte = *ptr++;
+        if (shift < 32) {
+            result |= (uint32_t) (byte & 0x7f) << shift;
+        }
+        shift += 7;
+        if (!(byte & 0x80)) {
+            break;
+        }
+    }
+    if (shift < 32 && (byte & 0x40)) {
+        result |= -((uint32_t) 1 << shift);
+    }
+    return result;
+}
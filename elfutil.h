@@ -19,6 +19,14 @@
 #define SHT_PROGBITS 0x1
 #define SHT_SYMTAB 0x2
 #define SHT_STRTAB 0x3
+#define SHT_NOBITS 0x8
+#define SHT_RISCV_ATTRIBUTES 0x70000003
+
+#define SHF_ALLOC 0x2
+#define SHF_EXECINSTR 0x4
+
+#define TAG_FILE 1
+#define TAG_RISCV_ARCH 5
 
 #define SHN_UNDEF 0
 #define SHN_LORESERVE 0xff00
@@ -41,6 +49,8 @@
 
 #define ELF32_ST_BIND(i) ((i)>>4)
 
+#define ELF32_ST_INFO(b, t) (((b)<<4)+((t)&0xf))
+
 #define ELF32_ST_VISIBILITY(o) ((o)&0x3)
 
 #define STV_DEFAULT 0
@@ -116,4 +126,9 @@ const char * get_vis(unsigned char st_other);
 
 const char * get_bind(unsigned char st_info); 
 
+// LEB128 numbers of .riscv.attributes and DWARF, never read past end
+uint32_t read_uleb128(const unsigned char *&ptr, const unsigned char *end);
+
+int32_t read_sleb128(const unsigned char *&ptr, const unsigned char *end);
+
 #endif
@@ -0,0 +1,92 @@
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <tmmintrin.h>
+#define HEXDUMP_SSSE3
+#endif
+
+#include "hexdump.h"
+
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+
+static void format_address(Elf32_Addr addr, char *dest) {
+    for (int i = 7; i >= 0; i--) {
+        dest[i] = HEX_DIGITS[addr & 0xf];
+        addr >>= 4;
+    }
+}
+
+
+static void format_bytes_scalar(const unsigned char *data, size_t size, char *hex, char *ascii) {
+    for (size_t i = 0; i < HEX_ROW_BYTES; i++) {
+        if (i < size) {
+            hex[2 * i] = HEX_DIGITS[data[i] >> 4];
+            hex[2 * i + 1] = HEX_DIGITS[data[i] & 0xf];
+            ascii[i] = data[i] >= 0x20 && data[i] < 0x7f ? data[i] : '.';
+        }
+        else {
+            hex[2 * i] = hex[2 * i + 1] = ' ';
+            ascii[i] = ' ';
+        }
+    }
+}
+
+
+#ifdef HEXDUMP_SSSE3
+// Built for SSSE3 whatever the target, only called when the CPU has it
+__attribute__((target("ssse3")))
+static void format_bytes_ssse3(const unsigned char *data, char *hex, char *ascii) {
+    const __m128i digits = _mm_loadu_si128((const __m128i *) HEX_DIGITS);
+    const __m128i low_mask = _mm_set1_epi8(0x0f);
+    __m128i bytes = _mm_loadu_si128((const __m128i *) data);
+    __m128i high = _mm_and_si128(_mm_srli_epi16(bytes, 4), low_mask);
+    __m128i low = _mm_and_si128(bytes, low_mask);
+    high = _mm_shuffle_epi8(digits, high);
+    low = _mm_shuffle_epi8(digits, low);
+    _mm_storeu_si128((__m128i *) hex, _mm_unpacklo_epi8(high, low));
+    _mm_storeu_si128((__m128i *) (hex + 16), _mm_unpackhi_epi8(high, low));
+    // signed compares: bytes >= 0x80 are negative and fail the first test
+    __m128i printable = _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8(0x1f)), _mm_cmplt_epi8(bytes, _mm_set1_epi8(0x7f)));
+    __m128i chars = _mm_or_si128(_mm_and_si128(printable, bytes), _mm_andnot_si128(printable, _mm_set1_epi8('.')));
+    _mm_storeu_si128((__m128i *) ascii, chars);
+}
+
+
+static bool cpu_has_ssse3() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("ssse3");
+}
+
+
+static const bool HAS_SSSE3 = cpu_has_ssse3();
+#endif
+
+
+void format_hex_row(Elf32_Addr addr, const unsigned char *data, size_t size, char *dest) {
+    char hex[2 * HEX_ROW_BYTES];
+    char ascii[HEX_ROW_BYTES];
+#ifdef HEXDUMP_SSSE3
+    if (HAS_SSSE3 && size >= HEX_ROW_BYTES) {
+        format_bytes_ssse3(data, hex, ascii);
+    }
+    else {
+        format_bytes_scalar(data, size, hex, ascii);
+    }
+#else
+    format_bytes_scalar(data, size, hex, ascii);
+#endif
+    format_address(addr, dest);
+    char *ptr = dest + 8;
+    for (int group = 0; group < 4; group++) {
+        *ptr++ = ' ';
+        memcpy(ptr, hex + 8 * group, 8);
+        ptr += 8;
+    }
+    *ptr++ = ' ';
+    *ptr++ = ' ';
+    memcpy(ptr, ascii, HEX_ROW_BYTES);
+    ptr += HEX_ROW_BYTES;
+    *ptr = '\n';
+}
@@ -0,0 +1,18 @@
+#ifndef HEXDUMP_H
+#define HEXDUMP_H
+
+#include <cstddef>
+
+#include "elfutil.h"
+
+#define HEX_ROW_BYTES 16
+#define HEX_ROW_SIZE 63
+
+
+// Formats up to 16 bytes as one objdump -s style row:
+// "0001112c 00010203 04050607 08090a0b 0c0d0e0f  ................\n".
+// Writes exactly HEX_ROW_SIZE characters; full rows are converted with
+// SSSE3 shuffles when the CPU supports them.
+void format_hex_row(Elf32_Addr addr, const unsigned char *data, size_t size, char *dest);
+
+#endif
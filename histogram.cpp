@@ -0,0 +1,64 @@
+#include "histogram.h"
+#include "riscvutil.h"
+#include "riscvext.h"
+
+#define RD_RS1_MASK 0x000f8f80
+
+const MnemonicClassTable mnemonic_classes;
+
+
+MnemonicClassTable::MnemonicClassTable() {
+    slot_count = 0;
+    for (uint32_t i = 0; i < MNEMONIC_CLASS_COUNT; i++) {
+        Opcode opcode = i & 0x7f;
+        Funct3 funct3 = i >> 7;
+        MnemonicClass &mnemonic_class = classes[i];
+        bool shift = opcode == OP_IMM && (funct3 == 0b001 || funct3 == 0b101);
+        bool fma = opcode == MADD || opcode == MSUB || opcode == NMSUB || opcode == NMADD;
+        bool atomic = opcode == AMO && funct3 == 0b010;
+        bool priv = opcode == SYSTEM && funct3 == PRIV;
+        mnemonic_class.base = slot_count;
+        mnemonic_class.upper_mask = opcode == OP || opcode == OP_FP || shift || fma || atomic || priv ? 0xfff : 0;
+        mnemonic_class.register_mask = priv ? RD_RS1_MASK : 0;
+        slot_count += (mnemonic_class.upper_mask + 1) * (priv ? 2 : 1);
+    }
+}
+
+
+Histogram::Histogram() : slots(mnemonic_classes.slot_count) {}
+
+
+void Histogram::merge(const Histogram &other) {
+    for (size_t i = 0; i < slots.size(); i++) {
+        slots[i] += other.slots[i];
+    }
+    if (functions.size() < other.functions.size()) {
+        functions.resize(other.functions.size());
+    }
+    for (size_t i = 0; i < other.functions.size(); i++) {
+        functions[i] += other.functions[i];
+    }
+    total += other.total;
+}
+
+
+const char * get_format_name(InstructionFormat format) {
+    switch (format) {
+        case FORMAT_R:
+            return "R";
+        case FORMAT_I:
+            return "I";
+        case FORMAT_S:
+            return "S";
+        case FORMAT_B:
+            return "B";
+        case FORMAT_U:
+            return "U";
+        case FORMAT_J:
+            return "J";
+        case FORMAT_UNKNOWN:
+            return "unknown";
+        default:
+            return nullptr;
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define MNEMONIC_CLASS_COUNT 1024
+
+
+enum InstructionFormat {
+    FORMAT_R,
+    FORMAT_I,
+    FORMAT_S,
+    FORMAT_B,
+    FORMAT_U,
+    FORMAT_J,
+    FORMAT_UNKNOWN,
+    FORMAT_COUNT,
+};
+
+
+// Count slots of one opcode/funct3 pair. Opcodes whose mnemonic also depends
+// on funct7 or rs2 get a slot per value of bits 31:20, ecall/ebreak another
+// set for words with a nonzero rd or rs1.
+struct MnemonicClass {
+    uint32_t base;
+    uint32_t upper_mask;
+    uint32_t register_mask;
+};
+
+
+// Indexed by opcode | funct3 << 7
+struct MnemonicClassTable {
+    MnemonicClassTable();
+    MnemonicClass classes[MNEMONIC_CLASS_COUNT];
+    uint32_t slot_count;
+};
+
+extern const MnemonicClassTable mnemonic_classes;
+
+
+inline uint32_t get_mnemonic_slot(uint32_t instruction) {
+    const MnemonicClass &mnemonic_class = mnemonic_classes.classes[(instruction & 0x7f) | ((instruction >> 5) & 0x380)];
+    uint32_t upper = (instruction >> 20) & mnemonic_class.upper_mask;
+    uint32_t registers = (instruction & mnemonic_class.register_mask) != 0;
+    return mnemonic_class.base + upper + registers * (mnemonic_class.upper_mask + 1);
+}
+
+
+// Counts are kept per slot and only turned into mnemonics and formats when
+// printed, each slot decoding to a single mnemonic.
+struct Histogram {
+    Histogram();
+    std::vector<uint64_t> slots;
+    std::vector<uint64_t> functions;
+    uint64_t total = 0;
+
+    void merge(const Histogram &other);
+};
+
+// Calls f(slot, instruction) with a word counted in each slot
+template <class F>
+void for_each_mnemonic_slot(F f) {
+    for (uint32_t i = 0; i < MNEMONIC_CLASS_COUNT; i++) {
+        const MnemonicClass &mnemonic_class = mnemonic_classes.classes[i];
+        uint32_t upper_count = mnemonic_class.upper_mask + 1;
+        uint32_t count = upper_count * (mnemonic_class.register_mask != 0 ? 2 : 1);
+        for (uint32_t j = 0; j < count; j++) {
+            uint32_t registers = j / upper_count != 0 ? mnemonic_class.register_mask & -mnemonic_class.register_mask : 0;
+            f(mnemonic_class.base + j, (i & 0x7f) | (i >> 7) << 12 | (j % upper_count) << 20 | registers);
+        }
+    }
+}
+
+const char * get_format_name(InstructionFormat format);
+
+#endif
@@ -0,0 +1,775 @@
+#include <algorithm>
+#include <cstring>
+
+#include "lines.h"
+
+
+static bool read_fixed(const unsigned char *&ptr, const unsigned char *end, size_t size, uint64_t &value) {
+    if ((size_t) (end - ptr) < size) {
+        return false;
+    }
+    value = 0;
+    for (size_t i = 0; i < size; i++) {
+        value |= (uint64_t) ptr[i] << (8 * i);
+    }
+    ptr += size;
+    return true;
+}
+
+
+static bool read_constant(const unsigned char *&ptr, const unsigned char *end, unsigned form, uint64_t &value) {
+    switch (form) {
+        case DW_FORM_UDATA:
+            value = read_uleb128(ptr, end);
+            return true;
+        case DW_FORM_DATA1:
+            return read_fixed(ptr, end, 1, value);
+        case DW_FORM_DATA2:
+            return read_fixed(ptr, end, 2, value);
+        case DW_FORM_DATA4:
+            return read_fixed(ptr, end, 4, value);
+        case DW_FORM_DATA8:
+            return read_fixed(ptr, end, 8, value);
+        default:
+            return false;
+    }
+}
+
+
+static const char * find_string(const char *strings, size_t size, uint64_t offset) {
+    if (strings == nullptr || offset >= size || strnlen(strings + offset, size - offset) == size - offset) {
+        return nullptr;
+    }
+    return strings + offset;
+}
+
+
+static bool compare_rows(const LineRow &a, const LineRow &b) {
+    // An end of sequence goes before a sequence starting at the same address
+    return a.addr != b.addr ? a.addr < b.addr : (a.line != 0) < (b.line != 0);
+}
+
+
+void LineTable::init(const char *data, size_t size, const char *line_strings, size_t line_strings_size) {
+    this->data = (const unsigned char *) data;
+    data_size = size;
+    this->line_strings = line_strings;
+    this->line_strings_size = line_strings_size;
+}
+
+
+void LineTable::init_info(const DebugInfoSections &sections) {
+    this->sections = sections;
+}
+
+
+bool LineTable::parse_unit(const unsigned char *&ptr, Unit &unit) {
+    const unsigned char *end = data + data_size;
+    uint64_t length;
+    if (!read_fixed(ptr, end, 4, length)) {
+        return false;
+    }
+    unit.is_64 = length == 0xffffffff;
+    if (unit.is_64 && !read_fixed(ptr, end, 8, length)) {
+        return false;
+    }
+    if (length > (uint64_t) (end - ptr)) {
+        return false;
+    }
+    unit.end = ptr + length;
+    unit.version = 0;
+    unit.program = unit.end;
+    unit.files_begin = LINE_NO_FILE;
+    unit.files_count = 0;
+    const unsigned char *header = ptr;
+    ptr = unit.end;
+    uint64_t value;
+    if (!read_fixed(header, unit.end, 2, value)) {
+        return true;
+    }
+    unit.version = value;
+    if (unit.version < 2 || unit.version > 5) {
+        // Unknown layout, the unit keeps an empty program
+        return true;
+    }
+    if (unit.version >= 5 && !read_fixed(header, unit.end, 2, value)) {
+        return true;
+    }
+    uint64_t header_length;
+    if (!read_fixed(header, unit.end, unit.is_64 ? 8 : 4, header_length) || header_length > (uint64_t) (unit.end - header)) {
+        return true;
+    }
+    const unsigned char *program = header + header_length;
+    size_t fields = unit.version >= 4 ? 6 : 5;
+    if ((size_t) (program - header) < fields) {
+        return true;
+    }
+    unit.min_instruction_length = *header++;
+    if (unit.version >= 4) {
+        // maximum_operations_per_instruction, always 1 outside VLIW
+        header++;
+    }
+    header++;
+    unit.line_base = (int8_t) *header++;
+    unit.line_range = *header++;
+    unit.opcode_base = *header++;
+    if (unit.line_range == 0 || unit.opcode_base == 0 || (size_t) (program - header) < unit.opcode_base - 1u) {
+        return true;
+    }
+    unit.opcode_lengths = header;
+    unit.tables = header + unit.opcode_base - 1;
+    unit.program = program;
+    return true;
+}
+
+
+const unsigned char * LineTable::run(const Unit &unit, const unsigned char *ptr, Elf32_Addr &low, Elf32_Addr &high, std::vector<LineRow> *rows) {
+    Elf32_Addr addr = 0;
+    uint32_t file = 1;
+    uint32_t line = 1;
+    bool empty = true;
+    auto emit = [&](uint32_t row_line) {
+        if (empty) {
+            low = addr;
+            empty = false;
+        }
+        high = std::max(high, addr);
+        if (rows == nullptr) {
+            return;
+        }
+        uint32_t index = unit.version >= 5 ? file : file - 1;
+        uint32_t global = index < unit.files_count ? unit.files_begin + index : LINE_NO_FILE;
+        rows->push_back({addr, row_line == 0 ? LINE_NO_FILE : global, row_line});
+    };
+    low = high = 0;
+    while (ptr < unit.end) {
+        uint8_t opcode = *ptr++;
+        if (opcode >= unit.opcode_base) {
+            uint8_t adjusted = opcode - unit.opcode_base;
+            addr += adjusted / unit.line_range * unit.min_instruction_length;
+            line += unit.line_base + adjusted % unit.line_range;
+            emit(line);
+            continue;
+        }
+        uint64_t value;
+        switch (opcode) {
+            case 0:
+            {
+                uint32_t length = read_uleb128(ptr, unit.end);
+                if (length == 0 || length > (size_t) (unit.end - ptr)) {
+                    return unit.end;
+                }
+                const unsigned char *next = ptr + length;
+                uint8_t extended = *ptr++;
+                if (extended == DW_LNE_END_SEQUENCE) {
+                    emit(0);
+                    return next;
+                }
+                // 64-bit addresses keep their low half, RV32 code fits in it
+                if (extended == DW_LNE_SET_ADDRESS && read_fixed(ptr, next, std::min<size_t>(length - 1, 4), value)) {
+                    addr = value;
+                }
+                ptr = next;
+                break;
+            }
+            case DW_LNS_COPY:
+                emit(line);
+                break;
+            case DW_LNS_ADVANCE_PC:
+                addr += read_uleb128(ptr, unit.end) * unit.min_instruction_length;
+                break;
+            case DW_LNS_ADVANCE_LINE:
+                line += read_sleb128(ptr, unit.end);
+                break;
+            case DW_LNS_SET_FILE:
+                file = read_uleb128(ptr, unit.end);
+                break;
+            case DW_LNS_CONST_ADD_PC:
+                addr += (255 - unit.opcode_base) / unit.line_range * unit.min_instruction_length;
+                break;
+            case DW_LNS_FIXED_ADVANCE_PC:
+                if (!read_fixed(ptr, unit.end, 2, value)) {
+                    return unit.end;
+                }
+                addr += value;
+                break;
+            default:
+                for (uint8_t i = 0; i < unit.opcode_lengths[opcode - 1]; i++) {
+                    read_uleb128(ptr, unit.end);
+                }
+                break;
+        }
+    }
+    return ptr;
+}
+
+
+// Units are mapped to addresses by .debug_aranges, or else by their
+// .debug_info entries. Walking every line program is the last resort, for
+// images where neither covers all units.
+void LineTable::index() {
+    indexed = true;
+    if (index_aranges()) {
+        return;
+    }
+    unit_ranges.clear();
+    if (index_unit_entries()) {
+        return;
+    }
+    unit_ranges.clear();
+    const unsigned char *ptr = data;
+    while (ptr < data + data_size && index_unit(ptr)) {
+    }
+}
+
+
+bool LineTable::index_unit(const unsigned char *&ptr) {
+    auto comp_dir = comp_dirs.find(ptr - data);
+    Unit unit;
+    if (!parse_unit(ptr, unit)) {
+        return false;
+    }
+    unit.comp_dir = comp_dir != comp_dirs.end() ? comp_dir->second : nullptr;
+    units.push_back(unit);
+    const unsigned char *program = unit.program;
+    while (program < unit.end) {
+        Sequence sequence{(uint32_t) (units.size() - 1), program, 0, 0, false};
+        program = run(unit, program, sequence.low, sequence.high, nullptr);
+        sequences.push_back(sequence);
+    }
+    return true;
+}
+
+
+// Any set that can't be followed to a line program falls back to the full walk
+bool LineTable::index_aranges() {
+    if (sections.aranges == nullptr || sections.info == nullptr || sections.abbrev == nullptr) {
+        return false;
+    }
+    const unsigned char *ptr = (const unsigned char *) sections.aranges;
+    const unsigned char *end = ptr + sections.aranges_size;
+    while (ptr < end) {
+        const unsigned char *set = ptr;
+        uint64_t length;
+        if (!read_fixed(ptr, end, 4, length)) {
+            return false;
+        }
+        bool is_64 = length == 0xffffffff;
+        if (is_64 && !read_fixed(ptr, end, 8, length)) {
+            return false;
+        }
+        if (length > (uint64_t) (end - ptr)) {
+            return false;
+        }
+        const unsigned char *set_end = ptr + length;
+        uint64_t version;
+        uint64_t info_offset;
+        if (!read_fixed(ptr, set_end, 2, version) || version != 2 || !read_fixed(ptr, set_end, is_64 ? 8 : 4, info_offset)
+                || set_end - ptr < 2 || info_offset >= sections.info_size) {
+            return false;
+        }
+        const unsigned char *info = (const unsigned char *) sections.info + info_offset;
+        UnitEntry entry;
+        if (!read_unit_entry(info, entry) || !entry.has_line_offset) {
+            return false;
+        }
+        uint8_t address_size = *ptr++;
+        uint8_t segment_size = *ptr++;
+        if ((address_size != 4 && address_size != 8) || segment_size != 0) {
+            return false;
+        }
+        // Tuples are aligned to their own size from the start of the set
+        size_t tuple_size = 2 * address_size;
+        ptr = set + (ptr - set + tuple_size - 1) / tuple_size * tuple_size;
+        uint64_t address;
+        uint64_t size;
+        while (read_fixed(ptr, set_end, address_size, address) && read_fixed(ptr, set_end, address_size, size) && (address != 0 || size != 0)) {
+            if (size != 0) {
+                unit_ranges.push_back({(Elf32_Addr) address, (Elf32_Addr) (address + size), entry.line_offset});
+            }
+        }
+        ptr = set_end;
+    }
+    return !unit_ranges.empty();
+}
+
+
+// Entries of units that can't be mapped leave only the full walk
+bool LineTable::index_unit_entries() {
+    if (sections.info == nullptr || sections.abbrev == nullptr) {
+        return false;
+    }
+    const unsigned char *ptr = (const unsigned char *) sections.info;
+    const unsigned char *end = ptr + sections.info_size;
+    bool usable = true;
+    while (ptr < end) {
+        UnitEntry entry;
+        if (!read_unit_entry(ptr, entry) || entry.unresolved) {
+            usable = false;
+        }
+        else if (entry.has_line_offset && !read_unit_ranges(entry)) {
+            usable = false;
+        }
+    }
+    return usable && !unit_ranges.empty();
+}
+
+
+// Reads the unit header at ptr and the attributes of its first entry, ptr is
+// left at the next unit
+bool LineTable::read_unit_entry(const unsigned char *&ptr, UnitEntry &entry) {
+    entry = UnitEntry();
+    const unsigned char *end = (const unsigned char *) sections.info + sections.info_size;
+    uint64_t length;
+    if (!read_fixed(ptr, end, 4, length)) {
+        ptr = end;
+        return false;
+    }
+    entry.is_64 = length == 0xffffffff;
+    if ((entry.is_64 && !read_fixed(ptr, end, 8, length)) || length > (uint64_t) (end - ptr)) {
+        ptr = end;
+        return false;
+    }
+    end = ptr + length;
+    const unsigned char *header = ptr;
+    ptr = end;
+    uint64_t version;
+    uint64_t unit_type = 0;
+    uint64_t address_size;
+    uint64_t abbrev_offset;
+    if (!read_fixed(header, end, 2, version) || version < 2 || version > 5) {
+        return false;
+    }
+    entry.version = version;
+    if (version >= 5) {
+        if (!read_fixed(header, end, 1, unit_type) || !read_fixed(header, end, 1, address_size) || !read_fixed(header, end, entry.is_64 ? 8 : 4, abbrev_offset)) {
+            return false;
+        }
+        // dwo_id
+        if ((unit_type == DW_UT_SKELETON || unit_type == DW_UT_SPLIT_COMPILE) && !read_fixed(header, end, 8, length)) {
+            return false;
+        }
+    }
+    else if (!read_fixed(header, end, entry.is_64 ? 8 : 4, abbrev_offset) || !read_fixed(header, end, 1, address_size)) {
+        return false;
+    }
+    entry.address_size = address_size;
+    if (abbrev_offset >= sections.abbrev_size) {
+        return false;
+    }
+    // The unit's first entry and its abbreviation
+    uint32_t code = read_uleb128(header, end);
+    const unsigned char *abbrev_end = (const unsigned char *) sections.abbrev + sections.abbrev_size;
+    const unsigned char *declaration = (const unsigned char *) sections.abbrev + abbrev_offset;
+    while (true) {
+        uint32_t declaration_code = read_uleb128(declaration, abbrev_end);
+        if (declaration_code == 0) {
+            return false;
+        }
+        read_uleb128(declaration, abbrev_end);
+        if (declaration >= abbrev_end) {
+            return false;
+        }
+        declaration++;
+        if (declaration_code == code) {
+            break;
+        }
+        uint32_t name;
+        uint32_t form;
+        do {
+            name = read_uleb128(declaration, abbrev_end);
+            form = read_uleb128(declaration, abbrev_end);
+            if (form == DW_FORM_IMPLICIT_CONST) {
+                read_sleb128(declaration, abbrev_end);
+            }
+        } while ((name != 0 || form != 0) && declaration < abbrev_end);
+    }
+    while (declaration < abbrev_end) {
+        uint32_t name = read_uleb128(declaration, abbrev_end);
+        uint32_t form = read_uleb128(declaration, abbrev_end);
+        if (name == 0 && form == 0) {
+            break;
+        }
+        uint64_t value;
+        bool read = true;
+        if (form == DW_FORM_IMPLICIT_CONST) {
+            value = read_sleb128(declaration, abbrev_end);
+        }
+        else if (form == DW_FORM_SEC_OFFSET) {
+            read = read_fixed(header, end, entry.is_64 ? 8 : 4, value);
+        }
+        else if (form == DW_FORM_ADDR) {
+            read = read_fixed(header, end, entry.address_size, value);
+        }
+        else if (name == DW_AT_COMP_DIR && form == DW_FORM_STRING) {
+            entry.comp_dir = read_string(header, end, form, entry.is_64);
+            if (entry.comp_dir == nullptr) {
+                return false;
+            }
+            continue;
+        }
+        else if (name == DW_AT_COMP_DIR && (form == DW_FORM_STRP || form == DW_FORM_LINE_STRP)) {
+            read = read_fixed(header, end, entry.is_64 ? 8 : 4, value);
+        }
+        else if (!read_constant(header, end, form, value)) {
+            if (name == DW_AT_LOW_PC || name == DW_AT_HIGH_PC || name == DW_AT_RANGES) {
+                entry.unresolved = true;
+            }
+            if (!skip_die_form(header, end, form, entry.is_64, entry.address_size, entry.version)) {
+                return false;
+            }
+            continue;
+        }
+        if (!read) {
+            return false;
+        }
+        if (name == DW_AT_STMT_LIST) {
+            entry.has_line_offset = value < data_size;
+            entry.line_offset = value;
+        }
+        else if (name == DW_AT_COMP_DIR && (form == DW_FORM_STRP || form == DW_FORM_LINE_STRP)) {
+            entry.comp_dir = form == DW_FORM_STRP ? find_string(sections.strings, sections.strings_size, value)
+                    : find_string(line_strings, line_strings_size, value);
+        }
+        else if (name == DW_AT_LOW_PC) {
+            entry.has_low_pc = form == DW_FORM_ADDR;
+            entry.unresolved |= !entry.has_low_pc;
+            entry.low_pc = value;
+        }
+        else if (name == DW_AT_HIGH_PC) {
+            entry.has_high_pc = true;
+            entry.high_pc_is_offset = form != DW_FORM_ADDR;
+            entry.high_pc = value;
+        }
+        else if (name == DW_AT_RANGES) {
+            entry.has_ranges = true;
+            entry.ranges_offset = value;
+        }
+    }
+    if (entry.has_line_offset && entry.comp_dir != nullptr) {
+        comp_dirs[entry.line_offset] = entry.comp_dir;
+    }
+    return true;
+}
+
+
+// A unit without DW_AT_low_pc or DW_AT_ranges has no code
+bool LineTable::read_unit_ranges(const UnitEntry &entry) {
+    if (!entry.has_ranges) {
+        if (entry.has_low_pc && entry.has_high_pc) {
+            uint64_t high = entry.high_pc_is_offset ? entry.low_pc + entry.high_pc : entry.high_pc;
+            if (high > entry.low_pc) {
+                unit_ranges.push_back({(Elf32_Addr) entry.low_pc, (Elf32_Addr) high, entry.line_offset});
+            }
+        }
+        return true;
+    }
+    uint64_t base = entry.has_low_pc ? entry.low_pc : 0;
+    uint64_t low;
+    uint64_t high;
+    if (entry.version < 5) {
+        if (sections.ranges == nullptr || entry.ranges_offset >= sections.ranges_size) {
+            return false;
+        }
+        const unsigned char *ptr = (const unsigned char *) sections.ranges + entry.ranges_offset;
+        const unsigned char *end = (const unsigned char *) sections.ranges + sections.ranges_size;
+        uint64_t selection = entry.address_size == 8 ? UINT64_MAX : UINT32_MAX;
+        while (true) {
+            if (!read_fixed(ptr, end, entry.address_size, low) || !read_fixed(ptr, end, entry.address_size, high)) {
+                return false;
+            }
+            if (low == 0 && high == 0) {
+                return true;
+            }
+            if (low == selection) {
+                base = high;
+            }
+            else if (high > low) {
+                unit_ranges.push_back({(Elf32_Addr) (base + low), (Elf32_Addr) (base + high), entry.line_offset});
+            }
+        }
+    }
+    if (sections.rnglists == nullptr || entry.ranges_offset >= sections.rnglists_size) {
+        return false;
+    }
+    const unsigned char *ptr = (const unsigned char *) sections.rnglists + entry.ranges_offset;
+    const unsigned char *end = (const unsigned char *) sections.rnglists + sections.rnglists_size;
+    while (ptr < end) {
+        switch (*ptr++) {
+            case DW_RLE_END_OF_LIST:
+                return true;
+            case DW_RLE_BASE_ADDRESS:
+                if (!read_fixed(ptr, end, entry.address_size, base)) {
+                    return false;
+                }
+                continue;
+            case DW_RLE_OFFSET_PAIR:
+                low = base + read_uleb128(ptr, end);
+                high = base + read_uleb128(ptr, end);
+                break;
+            case DW_RLE_START_END:
+                if (!read_fixed(ptr, end, entry.address_size, low) || !read_fixed(ptr, end, entry.address_size, high)) {
+                    return false;
+                }
+                break;
+            case DW_RLE_START_LENGTH:
+                if (!read_fixed(ptr, end, entry.address_size, low)) {
+                    return false;
+                }
+                high = low + read_uleb128(ptr, end);
+                break;
+            default:
+                // The indexed kinds need .debug_addr
+                return false;
+        }
+        if (ptr > end) {
+            return false;
+        }
+        if (high > low) {
+            unit_ranges.push_back({(Elf32_Addr) low, (Elf32_Addr) high, entry.line_offset});
+        }
+    }
+    return false;
+}
+
+
+bool LineTable::skip_die_form(const unsigned char *&ptr, const unsigned char *end, unsigned form, bool is_64, uint8_t address_size, uint16_t version) {
+    uint64_t value;
+    switch (form) {
+        case DW_FORM_FLAG_PRESENT:
+            return true;
+        case DW_FORM_FLAG:
+        case DW_FORM_REF1:
+        case DW_FORM_STRX1:
+        case DW_FORM_ADDRX1:
+            return read_fixed(ptr, end, 1, value);
+        case DW_FORM_REF2:
+        case DW_FORM_STRX2:
+        case DW_FORM_ADDRX2:
+            return read_fixed(ptr, end, 2, value);
+        case DW_FORM_STRX3:
+        case DW_FORM_ADDRX3:
+            return read_fixed(ptr, end, 3, value);
+        case DW_FORM_REF4:
+        case DW_FORM_REF_SUP4:
+        case DW_FORM_STRX4:
+        case DW_FORM_ADDRX4:
+            return read_fixed(ptr, end, 4, value);
+        case DW_FORM_REF8:
+        case DW_FORM_REF_SIG8:
+        case DW_FORM_REF_SUP8:
+            return read_fixed(ptr, end, 8, value);
+        case DW_FORM_ADDR:
+            return read_fixed(ptr, end, address_size, value);
+        case DW_FORM_REF_ADDR:
+            return read_fixed(ptr, end, version == 2 ? address_size : is_64 ? 8 : 4, value);
+        case DW_FORM_SEC_OFFSET:
+        case DW_FORM_STRP_SUP:
+            return read_fixed(ptr, end, is_64 ? 8 : 4, value);
+        case DW_FORM_SDATA:
+            read_sleb128(ptr, end);
+            return ptr <= end;
+        case DW_FORM_REF_UDATA:
+        case DW_FORM_STRX:
+        case DW_FORM_ADDRX:
+        case DW_FORM_LOCLISTX:
+        case DW_FORM_RNGLISTX:
+            read_uleb128(ptr, end);
+            return ptr <= end;
+        case DW_FORM_EXPRLOC:
+            return skip_form(ptr, end, DW_FORM_BLOCK, is_64);
+        case DW_FORM_INDIRECT:
+            form = read_uleb128(ptr, end);
+            return form != DW_FORM_INDIRECT && skip_die_form(ptr, end, form, is_64, address_size, version);
+        default:
+            return skip_form(ptr, end, form, is_64);
+    }
+}
+
+
+const char * LineTable::read_string(const unsigned char *&ptr, const unsigned char *end, unsigned form, bool is_64) {
+    if (form == DW_FORM_STRING) {
+        const char *string = (const char *) ptr;
+        size_t length = strnlen(string, end - ptr);
+        if (length == (size_t) (end - ptr)) {
+            return nullptr;
+        }
+        ptr += length + 1;
+        return string;
+    }
+    uint64_t offset;
+    if ((form != DW_FORM_LINE_STRP && form != DW_FORM_STRP) || !read_fixed(ptr, end, is_64 ? 8 : 4, offset)) {
+        return nullptr;
+    }
+    const char *string = form == DW_FORM_STRP ? find_string(sections.strings, sections.strings_size, offset)
+            : find_string(line_strings, line_strings_size, offset);
+    return string != nullptr ? string : "??";
+}
+
+
+bool LineTable::skip_form(const unsigned char *&ptr, const unsigned char *end, unsigned form, bool is_64) {
+    uint64_t value;
+    switch (form) {
+        case DW_FORM_STRING:
+        case DW_FORM_STRP:
+        case DW_FORM_LINE_STRP:
+            return read_string(ptr, end, form, is_64) != nullptr;
+        case DW_FORM_DATA16:
+            return read_fixed(ptr, end, 8, value) && read_fixed(ptr, end, 8, value);
+        case DW_FORM_BLOCK:
+            value = read_uleb128(ptr, end);
+            break;
+        case DW_FORM_BLOCK1:
+            if (!read_fixed(ptr, end, 1, value)) {
+                return false;
+            }
+            break;
+        case DW_FORM_BLOCK2:
+            if (!read_fixed(ptr, end, 2, value)) {
+                return false;
+            }
+            break;
+        case DW_FORM_BLOCK4:
+            if (!read_fixed(ptr, end, 4, value)) {
+                return false;
+            }
+            break;
+        default:
+            return read_constant(ptr, end, form, value);
+    }
+    if (value > (uint64_t) (end - ptr)) {
+        return false;
+    }
+    ptr += value;
+    return true;
+}
+
+
+void LineTable::load_files(Unit &unit) {
+    unit.files_begin = files.size();
+    const unsigned char *ptr = unit.tables;
+    const unsigned char *end = unit.program;
+    std::vector<const char *> directories;
+    if (unit.version < 5) {
+        // Directory 0 is the compilation directory, not listed in the table
+        directories.push_back(unit.comp_dir);
+        while (ptr < end && *ptr != '\0') {
+            const char *directory = read_string(ptr, end, DW_FORM_STRING, false);
+            if (directory == nullptr) {
+                break;
+            }
+            directories.push_back(directory);
+        }
+        ptr++;
+        while (ptr < end && *ptr != '\0') {
+            const char *name = read_string(ptr, end, DW_FORM_STRING, false);
+            if (name == nullptr) {
+                break;
+            }
+            uint32_t directory = read_uleb128(ptr, end);
+            read_uleb128(ptr, end);
+            read_uleb128(ptr, end);
+            files.push_back({directory < directories.size() ? directories[directory] : nullptr, name});
+        }
+    }
+    else {
+        for (int table = 0; table < 2 && ptr < end; table++) {
+            uint8_t format_count = *ptr++;
+            std::vector<std::pair<uint32_t, uint32_t>> formats;
+            for (uint8_t i = 0; i < format_count; i++) {
+                uint32_t content = read_uleb128(ptr, end);
+                formats.emplace_back(content, read_uleb128(ptr, end));
+            }
+            uint32_t count = read_uleb128(ptr, end);
+            for (uint32_t i = 0; i < count && ptr < end; i++) {
+                const char *path = "??";
+                uint64_t directory = 0;
+                bool valid = true;
+                for (const auto &format : formats) {
+                    if (format.first == DW_LNCT_PATH) {
+                        path = read_string(ptr, end, format.second, unit.is_64);
+                        valid = path != nullptr;
+                    }
+                    else if (format.first == DW_LNCT_DIRECTORY_INDEX) {
+                        valid = read_constant(ptr, end, format.second, directory);
+                    }
+                    else {
+                        valid = skip_form(ptr, end, format.second, unit.is_64);
+                    }
+                    if (!valid) {
+                        break;
+                    }
+                }
+                if (!valid) {
+                    ptr = end;
+                    break;
+                }
+                if (table == 0) {
+                    directories.push_back(path);
+                }
+                else {
+                    files.push_back({directory < directories.size() ? directories[directory] : nullptr, path});
+                }
+            }
+        }
+    }
+    unit.files_count = files.size() - unit.files_begin;
+}
+
+
+void LineTable::decode(Elf32_Addr begin, Elf32_Addr end, std::vector<LineRow> &result) {
+    if (data == nullptr) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!indexed) {
+        index();
+    }
+    for (const UnitRange &range : unit_ranges) {
+        if (range.high > begin && range.low < end && indexed_units.insert(range.line_offset).second) {
+            const unsigned char *ptr = data + range.line_offset;
+            index_unit(ptr);
+        }
+    }
+    size_t decoded = rows.size();
+    for (Sequence &sequence : sequences) {
+        if (sequence.decoded || sequence.high <= begin || sequence.low >= end) {
+            continue;
+        }
+        Unit &unit = units[sequence.unit];
+        if (unit.files_begin == LINE_NO_FILE) {
+            load_files(unit);
+        }
+        Elf32_Addr low;
+        Elf32_Addr high;
+        run(unit, sequence.program, low, high, &rows);
+        sequence.decoded = true;
+    }
+    if (rows.size() != decoded) {
+        std::stable_sort(rows.begin() + decoded, rows.end(), compare_rows);
+        std::inplace_merge(rows.begin(), rows.begin() + decoded, rows.end(), compare_rows);
+    }
+    for (size_t i = find(begin); i < rows.size() && rows[i].addr < end; i++) {
+        result.push_back(rows[i]);
+    }
+}
+
+
+size_t LineTable::find(Elf32_Addr addr) const {
+    auto row = std::upper_bound(rows.begin(), rows.end(), addr, [](Elf32_Addr addr, const LineRow &row) {
+        return addr < row.addr;
+    });
+    return row == rows.begin() ? 0 : row - rows.begin() - 1;
+}
+
+
+const char * LineTable::get_directory(uint32_t file) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return file < files.size() ? files[file].directory : nullptr;
+}
+
+
+const char * LineTable::get_file_name(uint32_t file) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return file < files.size() ? files[file].name : "??";
+}
@@ -0,0 +1,221 @@
+#ifndef LINES_H
+#define LINES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "elfutil.h"
+
+#define DW_LNS_COPY 1
+#define DW_LNS_ADVANCE_PC 2
+#define DW_LNS_ADVANCE_LINE 3
+#define DW_LNS_SET_FILE 4
+#define DW_LNS_CONST_ADD_PC 8
+#define DW_LNS_FIXED_ADVANCE_PC 9
+
+#define DW_LNE_END_SEQUENCE 1
+#define DW_LNE_SET_ADDRESS 2
+
+#define DW_LNCT_PATH 1
+#define DW_LNCT_DIRECTORY_INDEX 2
+
+#define DW_AT_STMT_LIST 0x10
+#define DW_AT_LOW_PC 0x11
+#define DW_AT_HIGH_PC 0x12
+#define DW_AT_COMP_DIR 0x1b
+#define DW_AT_RANGES 0x55
+
+#define DW_RLE_END_OF_LIST 0x00
+#define DW_RLE_OFFSET_PAIR 0x04
+#define DW_RLE_BASE_ADDRESS 0x05
+#define DW_RLE_START_END 0x06
+#define DW_RLE_START_LENGTH 0x07
+
+#define DW_UT_SKELETON 0x04
+#define DW_UT_SPLIT_COMPILE 0x05
+
+#define DW_FORM_ADDR 0x01
+#define DW_FORM_BLOCK2 0x03
+#define DW_FORM_BLOCK4 0x04
+#define DW_FORM_DATA2 0x05
+#define DW_FORM_DATA4 0x06
+#define DW_FORM_DATA8 0x07
+#define DW_FORM_STRING 0x08
+#define DW_FORM_BLOCK 0x09
+#define DW_FORM_BLOCK1 0x0a
+#define DW_FORM_DATA1 0x0b
+#define DW_FORM_FLAG 0x0c
+#define DW_FORM_SDATA 0x0d
+#define DW_FORM_STRP 0x0e
+#define DW_FORM_UDATA 0x0f
+#define DW_FORM_REF_ADDR 0x10
+#define DW_FORM_REF1 0x11
+#define DW_FORM_REF2 0x12
+#define DW_FORM_REF4 0x13
+#define DW_FORM_REF8 0x14
+#define DW_FORM_REF_UDATA 0x15
+#define DW_FORM_INDIRECT 0x16
+#define DW_FORM_SEC_OFFSET 0x17
+#define DW_FORM_EXPRLOC 0x18
+#define DW_FORM_FLAG_PRESENT 0x19
+#define DW_FORM_STRX 0x1a
+#define DW_FORM_ADDRX 0x1b
+#define DW_FORM_REF_SUP4 0x1c
+#define DW_FORM_STRP_SUP 0x1d
+#define DW_FORM_DATA16 0x1e
+#define DW_FORM_LINE_STRP 0x1f
+#define DW_FORM_REF_SIG8 0x20
+#define DW_FORM_IMPLICIT_CONST 0x21
+#define DW_FORM_LOCLISTX 0x22
+#define DW_FORM_RNGLISTX 0x23
+#define DW_FORM_REF_SUP8 0x24
+#define DW_FORM_STRX1 0x25
+#define DW_FORM_STRX2 0x26
+#define DW_FORM_STRX3 0x27
+#define DW_FORM_STRX4 0x28
+#define DW_FORM_ADDRX1 0x29
+#define DW_FORM_ADDRX2 0x2a
+#define DW_FORM_ADDRX3 0x2b
+#define DW_FORM_ADDRX4 0x2c
+
+#define LINE_NO_FILE UINT32_MAX
+
+
+// One row of the line number matrix. Line 0 marks the end of a sequence,
+// addresses from there on have no line information.
+struct LineRow {
+    Elf32_Addr addr;
+    uint32_t file;
+    uint32_t line;
+};
+
+
+// .debug_info and the sections its unit entries refer to, any of them may be
+// missing
+struct DebugInfoSections {
+    const char *info = nullptr;
+    size_t info_size = 0;
+    const char *abbrev = nullptr;
+    size_t abbrev_size = 0;
+    const char *aranges = nullptr;
+    size_t aranges_size = 0;
+    const char *strings = nullptr;
+    size_t strings_size = 0;
+    const char *ranges = nullptr;
+    size_t ranges_size = 0;
+    const char *rnglists = nullptr;
+    size_t rnglists_size = 0;
+};
+
+
+// .debug_line decoded on demand. A decode only indexes the line programs of
+// the units covering the requested range, mapped to addresses by
+// .debug_aranges or else by the DW_AT_low_pc/high_pc or DW_AT_ranges of the
+// units' .debug_info entries. Only when neither is usable does the first
+// decode walk every line program. Indexing finds where each sequence starts
+// and which addresses it covers; rows and file tables are materialized just
+// for sequences overlapping a requested range and kept sorted by address.
+// Decoded rows are cached, calls from several threads are serialized.
+class LineTable {
+public:
+    void init(const char *data, size_t size, const char *line_strings, size_t line_strings_size);
+    void init_info(const DebugInfoSections &sections);
+    // Appends the rows covering [begin, end) in address order, starting with
+    // the one covering begin
+    void decode(Elf32_Addr begin, Elf32_Addr end, std::vector<LineRow> &result);
+    const char * get_directory(uint32_t file) const;
+    const char * get_file_name(uint32_t file) const;
+private:
+    struct Unit {
+        uint16_t version;
+        bool is_64;
+        uint8_t min_instruction_length;
+        int8_t line_base;
+        uint8_t line_range;
+        uint8_t opcode_base;
+        const unsigned char *opcode_lengths;
+        const unsigned char *tables;
+        const unsigned char *program;
+        const unsigned char *end;
+        // DW_AT_comp_dir of the unit's .debug_info entry, directory 0 before DWARF 5
+        const char *comp_dir;
+        // Index of the unit's first file in files, LINE_NO_FILE until loaded
+        uint32_t files_begin;
+        uint32_t files_count;
+    };
+
+    struct Sequence {
+        uint32_t unit;
+        const unsigned char *program;
+        Elf32_Addr low;
+        Elf32_Addr high;
+        bool decoded;
+    };
+
+    struct File {
+        const char *directory;
+        const char *name;
+    };
+
+    struct UnitRange {
+        Elf32_Addr low;
+        Elf32_Addr high;
+        uint64_t line_offset;
+    };
+
+    // The attributes of a unit's first .debug_info entry used here
+    struct UnitEntry {
+        uint16_t version;
+        bool is_64;
+        uint8_t address_size;
+        bool has_line_offset;
+        uint64_t line_offset;
+        const char *comp_dir;
+        bool has_low_pc;
+        uint64_t low_pc;
+        bool has_high_pc;
+        bool high_pc_is_offset;
+        uint64_t high_pc;
+        bool has_ranges;
+        uint64_t ranges_offset;
+        // An address attribute in a form needing sections not read here
+        bool unresolved;
+    };
+
+    void index();
+    bool index_unit(const unsigned char *&ptr);
+    bool index_aranges();
+    bool index_unit_entries();
+    bool read_unit_entry(const unsigned char *&ptr, UnitEntry &entry);
+    bool read_unit_ranges(const UnitEntry &entry);
+    bool skip_die_form(const unsigned char *&ptr, const unsigned char *end, unsigned form, bool is_64, uint8_t address_size, uint16_t version);
+    bool parse_unit(const unsigned char *&ptr, Unit &unit);
+    const char * read_string(const unsigned char *&ptr, const unsigned char *end, unsigned form, bool is_64);
+    bool skip_form(const unsigned char *&ptr, const unsigned char *end, unsigned form, bool is_64);
+    void load_files(Unit &unit);
+    size_t find(Elf32_Addr addr) const;
+    const unsigned char * run(const Unit &unit, const unsigned char *ptr, Elf32_Addr &low, Elf32_Addr &high, std::vector<LineRow> *rows);
+
+    const unsigned char *data = nullptr;
+    size_t data_size = 0;
+    const char *line_strings = nullptr;
+    size_t line_strings_size = 0;
+    DebugInfoSections sections;
+    bool indexed = false;
+    // Empty when the full walk is used
+    std::vector<UnitRange> unit_ranges;
+    // By line program offset
+    std::unordered_map<uint64_t, const char *> comp_dirs;
+    std::unordered_set<uint64_t> indexed_units;
+    std::vector<Unit> units;
+    std::vector<Sequence> sequences;
+    std::vector<File> files;
+    std::vector<LineRow> rows;
+    mutable std::mutex mutex;
+};
+
+#endif
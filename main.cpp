@@ -1,15 +1,133 @@
 #include <iostream>
+#include <cstring>
+#include <cstdlib>
 
 #include "disasm.h"
+#include "server.h"
 #include "elfutil.h"
 #include "riscvutil.h"
 
 
+static void print_usage() {
+    std::cout << "Usage: disasm [options] <input> <output>" << std::endl;
+    std::cout << "       disasm [options] --serve <socket> [--cache N]" << std::endl;
+    std::cout << "  --compress gzip|zstd  compress the output" << std::endl;
+    std::cout << "  --threads N           number of worker threads" << std::endl;
+    std::cout << "  --histogram           print instruction mix statistics instead of the listing" << std::endl;
+    std::cout << "  --recursive           decode only code reachable from the entry point and functions" << std::endl;
+    std::cout << "  --demangle            demangle C++ symbol names" << std::endl;
+    std::cout << "  --annotate            resolve lui/auipc/gp based addresses to symbols" << std::endl;
+    std::cout << "  --symbol-offsets      show branch targets as <function+offset>" << std::endl;
+    std::cout << "  --march ARCH          decode extensions of ARCH instead of .riscv.attributes" << std::endl;
+    std::cout << "  --dump-sections       hex dump allocated data sections after .symtab" << std::endl;
+    std::cout << "  --objdump             print .text in objdump -d format" << std::endl;
+    std::cout << "  --stack               print worst-case stack usage per function after .symtab" << std::endl;
+    std::cout << "  --lines               interleave source lines from .debug_line with .text" << std::endl;
+    std::cout << "  --find PATTERN        print only instructions matching PATTERN, e.g. \"lw rs1=sp\"" << std::endl;
+    std::cout << "  --profile FILE        annotate .text with PC sample counts (ADDRESS COUNT per line)" << std::endl;
+    std::cout << "  --profile-threshold P list only functions with at least P% of the samples" << std::endl;
+    std::cout << "  --diff OLD            compare functions of OLD with <input> by name" << std::endl;
+    std::cout << "  --memory-report       print memory usage to stderr" << std::endl;
+    std::cout << "  --serve SOCKET        answer queries on a Unix domain socket" << std::endl;
+    std::cout << "  --cache N             number of images kept by the server" << std::endl;
+}
+
+
 int main(int argc, char* argv[]) {
-    if (argc != 3) {
+    DisasmOptions options;
+    const char *socket_path = nullptr;
+    size_t cache_capacity = 16;
+    const char *files[2];
+    int file_count = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--compress") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            if (strcmp(name, "gzip") == 0) {
+                options.compression = Compression::GZIP;
+            }
+            else if (strcmp(name, "zstd") == 0) {
+                options.compression = Compression::ZSTD;
+            }
+            else {
+                std::cout << "Unknown compression " << name << std::endl;
+                return 0;
+            }
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            options.threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--histogram") == 0) {
+            options.histogram = true;
+        }
+        else if (strcmp(argv[i], "--recursive") == 0) {
+            options.recursive = true;
+        }
+        else if (strcmp(argv[i], "--demangle") == 0) {
+            options.demangle = true;
+        }
+        else if (strcmp(argv[i], "--annotate") == 0) {
+            options.annotate = true;
+        }
+        else if (strcmp(argv[i], "--symbol-offsets") == 0) {
+            options.symbol_offsets = true;
+        }
+        else if (strcmp(argv[i], "--march") == 0 && i + 1 < argc) {
+            options.arch = argv[++i];
+        }
+        else if (strcmp(argv[i], "--dump-sections") == 0) {
+            options.dump_sections = true;
+        }
+        else if (strcmp(argv[i], "--objdump") == 0) {
+            options.objdump = true;
+        }
+        else if (strcmp(argv[i], "--stack") == 0) {
+            options.stack = true;
+        }
+        else if (strcmp(argv[i], "--lines") == 0) {
+            options.lines = true;
+        }
+        else if (strcmp(argv[i], "--find") == 0 && i + 1 < argc) {
+            options.find = argv[++i];
+        }
+        else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            options.profile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--profile-threshold") == 0 && i + 1 < argc) {
+            options.profile_threshold = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--diff") == 0 && i + 1 < argc) {
+            options.diff = argv[++i];
+        }
+        else if (strcmp(argv[i], "--memory-report") == 0) {
+            options.memory_report = true;
+        }
+        else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            socket_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            cache_capacity = atoi(argv[++i]);
+        }
+        else if (strncmp(argv[i], "--", 2) == 0 || file_count == 2) {
+            print_usage();
+            return 0;
+        }
+        else {
+            files[file_count++] = argv[i];
+        }
+    }
+    if (socket_path != nullptr && file_count == 0) {
+        DisasmServer server{socket_path, cache_capacity, options};
+        return server.run() ? 0 : 1;
+    }
+    if (file_count != 2) {
         std::cout << "Specify input and output files and only" << std::endl;
+        print_usage();
+        return 0;
+    }
+    if (!is_compression_supported(options.compression)) {
+        std::cout << "Compression " << get_compression_name(options.compression) << " is not compiled in" << std::endl;
         return 0;
     }
-    Disasm disasm{};
-    disasm.process(argv[1], argv[2]);
+    Disasm disasm{options};
+    disasm.process(files[0], files[1]);
 }
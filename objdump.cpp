@@ -0,0 +1,516 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "objdump.h"
+
+
+static bool decode_op_imm(Instruction instruction, ObjdumpInstruction &result) {
+    Funct3 funct3 = get_funct3(instruction);
+    const char *rd = get_reg_name(get_rd(instruction));
+    Register rs1 = get_rs1(instruction);
+    Immediate immediate = get_i_immediate(instruction);
+    size_t size = sizeof(result.operands);
+    if (is_i_shift(funct3, OP_IMM)) {
+        result.cmd = get_shift_cmd(get_shift_type(instruction), funct3);
+        snprintf(result.operands, size, "%s,%s,0x%x", rd, get_reg_name(rs1), get_shamt(instruction));
+        return result.cmd != nullptr;
+    }
+    result.cmd = get_i_cmd(funct3, OP_IMM);
+    if (result.cmd == nullptr) {
+        return false;
+    }
+    if (funct3 == 0b000 && get_rd(instruction) == REG_ZERO && rs1 == REG_ZERO && immediate == 0) {
+        result.cmd = "nop";
+        result.operands[0] = '\0';
+    }
+    else if (funct3 == 0b000 && rs1 == REG_ZERO) {
+        result.cmd = "li";
+        snprintf(result.operands, size, "%s,%d", rd, immediate);
+    }
+    else if (funct3 == 0b000 && immediate == 0) {
+        result.cmd = "mv";
+        snprintf(result.operands, size, "%s,%s", rd, get_reg_name(rs1));
+    }
+    else if (funct3 == 0b100 && immediate == -1) {
+        result.cmd = "not";
+        snprintf(result.operands, size, "%s,%s", rd, get_reg_name(rs1));
+    }
+    else if (funct3 == 0b011 && immediate == 1) {
+        result.cmd = "seqz";
+        snprintf(result.operands, size, "%s,%s", rd, get_reg_name(rs1));
+    }
+    else {
+        snprintf(result.operands, size, "%s,%s,%d", rd, get_reg_name(rs1), immediate);
+    }
+    return true;
+}
+
+
+static bool decode_op(Instruction instruction, ObjdumpInstruction &result) {
+    Funct7 funct7 = get_funct7(instruction);
+    Funct3 funct3 = get_funct3(instruction);
+    result.cmd = get_r_cmd(funct7, funct3);
+    if (result.cmd == nullptr) {
+        return false;
+    }
+    const char *rd = get_reg_name(get_rd(instruction));
+    Register rs1 = get_rs1(instruction);
+    Register rs2 = get_rs2(instruction);
+    size_t size = sizeof(result.operands);
+    if (funct7 == 0b0100000 && funct3 == 0b000 && rs1 == REG_ZERO) {
+        result.cmd = "neg";
+        snprintf(result.operands, size, "%s,%s", rd, get_reg_name(rs2));
+    }
+    else if (funct7 == 0b0000000 && funct3 == 0b011 && rs1 == REG_ZERO) {
+        result.cmd = "snez";
+        snprintf(result.operands, size, "%s,%s", rd, get_reg_name(rs2));
+    }
+    else if (funct7 == 0b0000000 && funct3 == 0b010 && rs2 == REG_ZERO) {
+        result.cmd = "sltz";
+        snprintf(result.operands, size, "%s,%s", rd, get_reg_name(rs1));
+    }
+    else if (funct7 == 0b0000000 && funct3 == 0b010 && rs1 == REG_ZERO) {
+        result.cmd = "sgtz";
+        snprintf(result.operands, size, "%s,%s", rd, get_reg_name(rs2));
+    }
+    else {
+        snprintf(result.operands, size, "%s,%s,%s", rd, get_reg_name(rs1), get_reg_name(rs2));
+    }
+    return true;
+}
+
+
+static bool decode_branch(Elf32_Addr addr, Instruction instruction, ObjdumpInstruction &result) {
+    Funct3 funct3 = get_funct3(instruction);
+    result.cmd = get_b_cmd(funct3);
+    if (result.cmd == nullptr) {
+        return false;
+    }
+    Register rs1 = get_rs1(instruction);
+    Register rs2 = get_rs2(instruction);
+    result.has_target = true;
+    result.target = addr + get_b_immediate(instruction);
+    size_t size = sizeof(result.operands);
+    const char *alias = nullptr;
+    Register reg = rs1;
+    if (rs2 == REG_ZERO) {
+        static const char * const ALIAS[] = {"beqz", "bnez", nullptr, nullptr, "bltz", "bgez", nullptr, nullptr};
+        alias = ALIAS[funct3];
+    }
+    else if (rs1 == REG_ZERO) {
+        static const char * const ALIAS[] = {nullptr, nullptr, nullptr, nullptr, "bgtz", "blez", nullptr, nullptr};
+        alias = ALIAS[funct3];
+        reg = rs2;
+    }
+    if (alias != nullptr) {
+        result.cmd = alias;
+        snprintf(result.operands, size, "%s,%x", get_reg_name(reg), result.target);
+    }
+    else {
+        snprintf(result.operands, size, "%s,%s,%x", get_reg_name(rs1), get_reg_name(rs2), result.target);
+    }
+    return true;
+}
+
+
+static bool decode_jalr(Instruction instruction, ObjdumpInstruction &result) {
+    if (get_funct3(instruction) != 0b000) {
+        return false;
+    }
+    Register rd = get_rd(instruction);
+    Register rs1 = get_rs1(instruction);
+    Immediate immediate = get_i_immediate(instruction);
+    size_t size = sizeof(result.operands);
+    result.cmd = "jalr";
+    if (rd == REG_ZERO && rs1 == REG_RA && immediate == 0) {
+        result.cmd = "ret";
+        result.operands[0] = '\0';
+    }
+    else if (rd == REG_ZERO || rd == REG_RA) {
+        // jr and jalr drop the implied link register
+        result.cmd = rd == REG_ZERO ? "jr" : "jalr";
+        if (immediate == 0) {
+            snprintf(result.operands, size, "%s", get_reg_name(rs1));
+        }
+        else {
+            snprintf(result.operands, size, "%d(%s)", immediate, get_reg_name(rs1));
+        }
+    }
+    else if (immediate == 0) {
+        snprintf(result.operands, size, "%s,%s", get_reg_name(rd), get_reg_name(rs1));
+    }
+    else {
+        snprintf(result.operands, size, "%s,%d(%s)", get_reg_name(rd), immediate, get_reg_name(rs1));
+    }
+    return true;
+}
+
+
+static void format_fence_set(uint8_t set, char *dest) {
+    const char *letters = "iorw";
+    for (int bit = 3; bit >= 0; bit--) {
+        if (set & (1 << bit)) {
+            *dest++ = letters[3 - bit];
+        }
+    }
+    *dest = '\0';
+}
+
+
+static bool decode_misc_mem(Instruction instruction, ObjdumpInstruction &result) {
+    Funct3 funct3 = get_funct3(instruction);
+    if (funct3 == 0b001) {
+        result.cmd = "fence.i";
+        result.operands[0] = '\0';
+        return true;
+    }
+    if (funct3 != 0b000) {
+        return false;
+    }
+    if (instruction == 0x8330000f) {
+        result.cmd = "fence.tso";
+        result.operands[0] = '\0';
+        return true;
+    }
+    uint8_t pred = (instruction >> 24) & 0xf;
+    uint8_t succ = (instruction >> 20) & 0xf;
+    result.cmd = "fence";
+    if (pred == 0xf && succ == 0xf) {
+        result.operands[0] = '\0';
+    }
+    else {
+        char pred_text[5];
+        char succ_text[5];
+        format_fence_set(pred, pred_text);
+        format_fence_set(succ, succ_text);
+        snprintf(result.operands, sizeof(result.operands), "%s,%s", pred_text, succ_text);
+    }
+    return true;
+}
+
+
+static bool decode_system(Instruction instruction, ObjdumpInstruction &result) {
+    if (get_funct3(instruction) == PRIV) {
+        result.operands[0] = '\0';
+        if (get_rd(instruction) != 0 || get_rs1(instruction) != 0) {
+            return false;
+        }
+        switch (get_funct12(instruction)) {
+            case ECALL:
+                result.cmd = "ecall";
+                return true;
+            case EBREAK:
+                result.cmd = "ebreak";
+                return true;
+            default:
+                return false;
+        }
+    }
+    return false;
+}
+
+
+// Extension decoders separate operands with ", ", objdump with ","
+static void strip_operand_spaces(char *operands) {
+    char *dest = operands;
+    for (const char *src = operands; *src != '\0'; src++) {
+        if (!(*src == ' ' && src > operands && src[-1] == ',')) {
+            *dest++ = *src;
+        }
+    }
+    *dest = '\0';
+}
+
+
+// objdump prints the rounding mode unless it is dyn, or rne for the exact
+// conversions to double
+static void append_rounding_mode(Instruction instruction, char *operands, size_t size) {
+    static const char * const ROUNDING_MODES[] = {"rne", "rtz", "rdn", "rup", "rmm", "unknown", "unknown", "dyn"};
+    Opcode opcode = instruction & 0b1111111;
+    Funct3 rounding_mode = get_funct3(instruction);
+    Funct3 implied = 0b111;
+    if (opcode == OP_FP) {
+        bool is_double = get_funct7(instruction) & 1;
+        switch (get_funct7(instruction) >> 2) {
+            case 0b00000:
+            case 0b00001:
+            case 0b00010:
+            case 0b00011:
+            case 0b01011:
+            case 0b11000:
+                break;
+            case 0b01000:
+            case 0b11010:
+                implied = is_double ? 0b000 : 0b111;
+                break;
+            default:
+                return;
+        }
+    }
+    else if (opcode != MADD && opcode != MSUB && opcode != NMSUB && opcode != NMADD) {
+        return;
+    }
+    if (rounding_mode != implied) {
+        size_t length = strlen(operands);
+        snprintf(operands + length, size - length, ",%s", ROUNDING_MODES[rounding_mode]);
+    }
+}
+
+
+// Reads and writes of the floating point and counter CSRs have their own names
+static bool decode_csr_alias(Instruction instruction, ObjdumpInstruction &result) {
+    Funct3 funct3 = get_funct3(instruction);
+    uint16_t csr = get_funct12(instruction);
+    Register rd = get_rd(instruction);
+    Register rs1 = get_rs1(instruction);
+    size_t size = sizeof(result.operands);
+    if (funct3 == 0b010 && rs1 == REG_ZERO) {
+        switch (csr) {
+            case 0x001:
+                result.cmd = "frflags";
+                break;
+            case 0x002:
+                result.cmd = "frrm";
+                break;
+            case 0x003:
+                result.cmd = "frcsr";
+                break;
+            case 0xc00:
+                result.cmd = "rdcycle";
+                break;
+            case 0xc01:
+                result.cmd = "rdtime";
+                break;
+            case 0xc02:
+                result.cmd = "rdinstret";
+                break;
+            case 0xc80:
+                result.cmd = "rdcycleh";
+                break;
+            case 0xc81:
+                result.cmd = "rdtimeh";
+                break;
+            case 0xc82:
+                result.cmd = "rdinstreth";
+                break;
+            default:
+                return false;
+        }
+        snprintf(result.operands, size, "%s", get_reg_name(rd));
+        return true;
+    }
+    // csrrw(i) rd, fflags/frm/fcsr, rs, fcsr has no immediate form
+    static const char * const WRITE[2][3] = {{"fsflags", "fsrm", "fscsr"}, {"fsflagsi", "fsrmi", nullptr}};
+    if ((funct3 != 0b001 && funct3 != 0b101) || csr < 0x001 || csr > 0x003 || WRITE[funct3 >> 2][csr - 1] == nullptr) {
+        return false;
+    }
+    result.cmd = WRITE[funct3 >> 2][csr - 1];
+    char source[8];
+    if (funct3 == 0b101) {
+        snprintf(source, sizeof(source), "%d", rs1);
+    }
+    else {
+        snprintf(source, sizeof(source), "%s", get_reg_name(rs1));
+    }
+    if (rd == REG_ZERO) {
+        snprintf(result.operands, size, "%s", source);
+    }
+    else {
+        snprintf(result.operands, size, "%s,%s", get_reg_name(rd), source);
+    }
+    return true;
+}
+
+
+static bool decode_extension_objdump(Instruction instruction, Extensions extensions, ObjdumpInstruction &result) {
+    result.cmd = decode_extension(instruction, extensions, result.operands, sizeof(result.operands));
+    if (result.cmd == nullptr) {
+        return false;
+    }
+    strip_operand_spaces(result.operands);
+    append_rounding_mode(instruction, result.operands, sizeof(result.operands));
+    Opcode opcode = instruction & 0b1111111;
+    Funct3 funct3 = get_funct3(instruction);
+    if (opcode == SYSTEM && decode_csr_alias(instruction, result)) {
+        return true;
+    }
+    if (opcode == OP_FP && get_funct7(instruction) >> 1 == 0b001000 && get_rs1(instruction) == get_rs2(instruction)) {
+        // fsgnj.fmt rd, rs, rs
+        static const char * const ALIAS[2][3] = {{"fmv.s", "fneg.s", "fabs.s"}, {"fmv.d", "fneg.d", "fabs.d"}};
+        result.cmd = ALIAS[get_funct7(instruction) & 1][funct3];
+        *strrchr(result.operands, ',') = '\0';
+    }
+    else if (opcode == SYSTEM && funct3 == 0b010 && get_rs1(instruction) == REG_ZERO) {
+        // csrrs rd, csr, zero
+        result.cmd = "csrr";
+        *strrchr(result.operands, ',') = '\0';
+    }
+    else if (opcode == SYSTEM && (funct3 & 0b011) != 0 && get_rd(instruction) == REG_ZERO) {
+        // csrrw/csrrs/csrrc(i) zero, csr, rs
+        static const char * const ALIAS[] = {nullptr, "csrw", "csrs", "csrc", nullptr, "csrwi", "csrsi", "csrci"};
+        result.cmd = ALIAS[funct3];
+        memmove(result.operands, result.operands + strlen("zero,"), strlen(result.operands) - strlen("zero,") + 1);
+    }
+    return true;
+}
+
+
+// objdump's compare_symbols for the flags ELF symbols can differ in
+static bool objdump_symbol_less(const ObjdumpSymbol &a, const ObjdumpSymbol &b, Elf32_Half text_section) {
+    if (a.value != b.value) {
+        return a.value < b.value;
+    }
+    if ((a.section == text_section) != (b.section == text_section)) {
+        return a.section == text_section;
+    }
+    size_t a_length = strlen(a.name);
+    size_t b_length = strlen(b.name);
+    bool a_file = a_length > 2 && a.name[a_length - 2] == '.' && (a.name[a_length - 1] == 'o' || a.name[a_length - 1] == 'a');
+    bool b_file = b_length > 2 && b.name[b_length - 2] == '.' && (b.name[b_length - 1] == 'o' || b.name[b_length - 1] == 'a');
+    if (a_file != b_file) {
+        return b_file;
+    }
+    unsigned char a_type = ELF32_ST_TYPE(a.info);
+    unsigned char b_type = ELF32_ST_TYPE(b.info);
+    if ((a_type == STT_FUNC) != (b_type == STT_FUNC)) {
+        return a_type == STT_FUNC;
+    }
+    if ((a_type == STT_OBJECT) != (b_type == STT_OBJECT)) {
+        return a_type == STT_OBJECT;
+    }
+    unsigned char a_bind = ELF32_ST_BIND(a.info);
+    unsigned char b_bind = ELF32_ST_BIND(b.info);
+    if ((a_bind == STB_LOCAL) != (b_bind == STB_LOCAL)) {
+        return b_bind == STB_LOCAL;
+    }
+    if ((a_bind == STB_GLOBAL) != (b_bind == STB_GLOBAL)) {
+        return a_bind == STB_GLOBAL;
+    }
+    if (a.size != b.size) {
+        return a.size > b.size;
+    }
+    if ((a.name[0] == '.') != (b.name[0] == '.')) {
+        return b.name[0] == '.';
+    }
+    return strcmp(a.name, b.name) < 0;
+}
+
+
+void ObjdumpSymbols::build(std::vector<ObjdumpSymbol> symbols, Elf32_Half text_section, Elf32_Addr text_addr) {
+    std::sort(symbols.begin(), symbols.end(), [text_section](const ObjdumpSymbol &a, const ObjdumpSymbol &b) {
+        return objdump_symbol_less(a, b, text_section);
+    });
+    this->symbols = std::move(symbols);
+    this->text_section = text_section;
+    this->text_addr = text_addr;
+}
+
+
+const ObjdumpSymbol * ObjdumpSymbols::find(Elf32_Addr addr) const {
+    auto upper = std::upper_bound(symbols.begin(), symbols.end(), addr, [](Elf32_Addr value, const ObjdumpSymbol &symbol) {
+        return value < symbol.value;
+    });
+    if (upper == symbols.begin()) {
+        return nullptr;
+    }
+    Elf32_Addr value = upper[-1].value;
+    auto first = std::lower_bound(symbols.begin(), upper, value, [](const ObjdumpSymbol &symbol, Elf32_Addr value) {
+        return symbol.value < value;
+    });
+    for (auto symbol = first; symbol != upper; ++symbol) {
+        if (symbol->section == text_section) {
+            return &*symbol;
+        }
+    }
+    return &*first;
+}
+
+
+void ObjdumpSymbols::format(Elf32_Addr addr, char *buffer, size_t size) const {
+    const ObjdumpSymbol *symbol = find(addr);
+    const char *name = symbol != nullptr ? symbol->name : ".text";
+    Elf32_Addr base = symbol != nullptr ? symbol->value : text_addr;
+    if (addr == base) {
+        snprintf(buffer, size, "<%s>", name);
+    }
+    else if (addr > base) {
+        snprintf(buffer, size, "<%s+0x%x>", name, addr - base);
+    }
+    else {
+        snprintf(buffer, size, "<%s-0x%x>", name, base - addr);
+    }
+}
+
+
+bool ObjdumpSymbols::empty() const {
+    return symbols.empty();
+}
+
+
+bool decode_objdump(Elf32_Addr addr, Instruction instruction, Extensions extensions, ObjdumpInstruction &result) {
+    Opcode opcode = instruction & 0b1111111;
+    size_t size = sizeof(result.operands);
+    result.has_target = false;
+    result.operands[0] = '\0';
+    bool decoded;
+    switch (opcode) {
+        case LUI:
+        case AUIPC:
+            result.cmd = get_u_cmd(opcode);
+            snprintf(result.operands, size, "%s,0x%x", get_reg_name(get_rd(instruction)), get_u_immediate(instruction));
+            decoded = true;
+            break;
+        case OP_IMM:
+            decoded = decode_op_imm(instruction, result);
+            break;
+        case OP:
+            decoded = decode_op(instruction, result);
+            break;
+        case LOAD:
+            result.cmd = get_load_jalr_cmd(get_funct3(instruction), opcode);
+            snprintf(result.operands, size, "%s,%d(%s)", get_reg_name(get_rd(instruction)), get_i_immediate(instruction), get_reg_name(get_rs1(instruction)));
+            decoded = result.cmd != nullptr;
+            break;
+        case STORE:
+            result.cmd = get_s_cmd(get_funct3(instruction));
+            snprintf(result.operands, size, "%s,%d(%s)", get_reg_name(get_rs2(instruction)), get_s_immediate(instruction), get_reg_name(get_rs1(instruction)));
+            decoded = result.cmd != nullptr;
+            break;
+        case JAL:
+        {
+            Register rd = get_rd(instruction);
+            result.has_target = true;
+            result.target = addr + get_j_immediate(instruction);
+            result.cmd = rd == REG_ZERO ? "j" : "jal";
+            if (rd == REG_ZERO || rd == REG_RA) {
+                snprintf(result.operands, size, "%x", result.target);
+            }
+            else {
+                snprintf(result.operands, size, "%s,%x", get_reg_name(rd), result.target);
+            }
+            decoded = true;
+            break;
+        }
+        case JALR:
+            decoded = decode_jalr(instruction, result);
+            break;
+        case BRANCH:
+            decoded = decode_branch(addr, instruction, result);
+            break;
+        case MISC_MEM:
+            decoded = decode_misc_mem(instruction, result);
+            break;
+        case SYSTEM:
+            decoded = decode_system(instruction, result);
+            break;
+        default:
+            decoded = false;
+            break;
+    }
+    if (!decoded) {
+        result.has_target = false;
+        decoded = decode_extension_objdump(instruction, extensions, result);
+    }
+    return decoded;
+}
@@ -0,0 +1,52 @@
+#ifndef OBJDUMP_H
+#define OBJDUMP_H
+
+#include <vector>
+
+#include "riscvutil.h"
+#include "riscvext.h"
+#include "elfutil.h"
+
+#define MISC_MEM 0b0001111
+
+
+struct ObjdumpInstruction {
+    const char *cmd;
+    char operands[64];
+    bool has_target;
+    Elf32_Addr target;
+};
+
+
+struct ObjdumpSymbol {
+    Elf32_Addr value;
+    Elf32_Word size;
+    const char *name;
+    Elf32_Half section;
+    unsigned char info;
+};
+
+
+// Names addresses the way objdump's disassembler does: the nearest symbol
+// at or below the address, preferring one from .text among those sharing a
+// value, and <.text+0x...> when there is none. Read-only after build.
+class ObjdumpSymbols {
+public:
+    void build(std::vector<ObjdumpSymbol> symbols, Elf32_Half text_section, Elf32_Addr text_addr);
+    const ObjdumpSymbol * find(Elf32_Addr addr) const;
+    void format(Elf32_Addr addr, char *buffer, size_t size) const;
+    bool empty() const;
+private:
+    std::vector<ObjdumpSymbol> symbols;
+    Elf32_Half text_section = 0;
+    Elf32_Addr text_addr = 0;
+};
+
+
+// Decodes an instruction the way riscv64-unknown-elf-objdump -d prints it:
+// comma separated operands without spaces, hexadecimal U-type immediates and
+// shift amounts, and the usual pseudo-instruction aliases (li, mv, ret, j,
+// beqz, ...). Returns false for words objdump would print as .insn.
+bool decode_objdump(Elf32_Addr addr, Instruction instruction, Extensions extensions, ObjdumpInstruction &result);
+
+#endif
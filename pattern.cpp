@@ -0,0 +1,231 @@
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "pattern.h"
+
+
+static const char * const FIELD_NAMES[PATTERN_FIELDS] = {"rd", "rs1", "rs2"};
+static const int FIELD_SHIFTS[PATTERN_FIELDS] = {7, 15, 20};
+
+
+static bool has_field(InstructionFormat format, int field) {
+    switch (format) {
+        case FORMAT_R:
+            return true;
+        case FORMAT_I:
+            return field != PATTERN_RS2;
+        case FORMAT_S:
+        case FORMAT_B:
+            return field != PATTERN_RD;
+        case FORMAT_U:
+        case FORMAT_J:
+            return field == PATTERN_RD;
+        default:
+            return false;
+    }
+}
+
+
+static bool get_immediate(Instruction instruction, InstructionFormat format, Immediate &immediate) {
+    Opcode opcode = instruction & 0b1111111;
+    switch (format) {
+        case FORMAT_I:
+            immediate = is_i_shift(get_funct3(instruction), opcode) ? get_shamt(instruction) : get_i_immediate(instruction);
+            return true;
+        case FORMAT_S:
+            immediate = get_s_immediate(instruction);
+            return true;
+        case FORMAT_B:
+            immediate = get_b_immediate(instruction);
+            return true;
+        case FORMAT_U:
+            immediate = get_u_immediate(instruction);
+            return true;
+        case FORMAT_J:
+            immediate = get_j_immediate(instruction);
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+static bool parse_register(const std::string &name, Register &reg) {
+    for (Register i = 0; i < 32; i++) {
+        if (name == get_reg_name(i)) {
+            reg = i;
+            return true;
+        }
+    }
+    char *end;
+    long number = name.size() > 1 && name[0] == 'x' ? strtol(name.c_str() + 1, &end, 10) : -1;
+    if (number < 0 || number >= 32 || *end != '\0') {
+        return false;
+    }
+    reg = number;
+    return true;
+}
+
+
+static bool parse_immediate(const char *text, const char *expected_end, Immediate &immediate) {
+    char *end;
+    long value = strtol(text, &end, 0);
+    immediate = value;
+    return end != text && end == expected_end;
+}
+
+
+bool InstructionPattern::parse_constraint(const std::string &token) {
+    size_t equals = token.find('=');
+    if (equals == std::string::npos || equals == 0) {
+        return false;
+    }
+    bool negate = token[equals - 1] == '!';
+    std::string name = token.substr(0, negate ? equals - 1 : equals);
+    std::string value = token.substr(equals + 1);
+    for (int field = 0; field < PATTERN_FIELDS; field++) {
+        if (name == FIELD_NAMES[field]) {
+            registers[field].active = true;
+            registers[field].negate = negate;
+            return parse_register(value, registers[field].reg);
+        }
+    }
+    if (name != "imm" || negate) {
+        return false;
+    }
+    has_immediate = true;
+    const char *text = value.c_str();
+    const char *range = strstr(text, "..");
+    if (range == nullptr) {
+        bool valid = parse_immediate(text, text + value.size(), low);
+        high = low;
+        return valid;
+    }
+    return parse_immediate(text, range, low) && parse_immediate(range + 2, text + value.size(), high);
+}
+
+
+bool InstructionPattern::find_encoding(const CommandDecoder &get_cmd, Instruction &instruction, InstructionFormat &format) const {
+    // Only opcode, funct3, funct7 and rs2 (which selects some extension
+    // instructions, e.g. fcvt.wu.s or cpop) pick the mnemonic
+    for (Instruction opcode = 0b11; opcode < 0b10000000; opcode += 0b100) {
+        for (Instruction funct3 = 0; funct3 < 8; funct3++) {
+            for (Instruction funct7 = 0; funct7 < 128; funct7++) {
+                for (Instruction rs2 = 0; rs2 < 32; rs2++) {
+                    instruction = opcode | funct3 << 12 | rs2 << 20 | funct7 << 25;
+                    const char *cmd = get_cmd(instruction, format);
+                    if (cmd != nullptr && mnemonic == cmd) {
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+    return false;
+}
+
+
+bool InstructionPattern::compile(const char *text, const CommandDecoder &get_cmd) {
+    std::istringstream stream(text);
+    std::string token;
+    if (!(stream >> token)) {
+        return false;
+    }
+    mnemonic = token == "*" ? "" : token;
+    while (stream >> token) {
+        if (!parse_constraint(token)) {
+            return false;
+        }
+    }
+    if (mnemonic.empty()) {
+        return true;
+    }
+    Instruction seed;
+    InstructionFormat format;
+    if (!find_encoding(get_cmd, seed, format)) {
+        return false;
+    }
+    // A bit belongs to the encoding if flipping it changes the mnemonic
+    filter.mask = 0b1111111;
+    for (int bit = 7; bit < 32; bit++) {
+        InstructionFormat flipped_format;
+        const char *cmd = get_cmd(seed ^ (1u << bit), flipped_format);
+        if (cmd == nullptr || mnemonic != cmd) {
+            filter.mask |= 1u << bit;
+        }
+    }
+    filter.value = seed & filter.mask;
+    for (int field = 0; field < PATTERN_FIELDS; field++) {
+        if (!registers[field].active) {
+            continue;
+        }
+        if (!has_field(format, field)) {
+            return false;
+        }
+        if (!registers[field].negate) {
+            Instruction field_mask = 0b11111u << FIELD_SHIFTS[field];
+            filter.mask |= field_mask;
+            filter.value = (filter.value & ~field_mask) | (Instruction) registers[field].reg << FIELD_SHIFTS[field];
+        }
+    }
+    has_filter = true;
+    return true;
+}
+
+
+void InstructionPattern::scan(const char *code, Elf32_Word size, std::vector<Elf32_Word> &candidates) const {
+    const Instruction *words = (const Instruction *) code;
+    Elf32_Word count = size / ILEN_BYTE;
+    Elf32_Word i = 0;
+    if (!has_filter) {
+        for (; i < count; i++) {
+            candidates.push_back(i);
+        }
+        return;
+    }
+#ifdef __SSE2__
+    const __m128i mask = _mm_set1_epi32(filter.mask);
+    const __m128i value = _mm_set1_epi32(filter.value);
+    for (; i + 4 <= count; i += 4) {
+        __m128i block = _mm_loadu_si128((const __m128i *) (words + i));
+        __m128i equal = _mm_cmpeq_epi32(_mm_and_si128(block, mask), value);
+        int hits = _mm_movemask_ps(_mm_castsi128_ps(equal));
+        while (hits != 0) {
+            candidates.push_back(i + __builtin_ctz(hits));
+            hits &= hits - 1;
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        if ((words[i] & filter.mask) == filter.value) {
+            candidates.push_back(i);
+        }
+    }
+}
+
+
+bool InstructionPattern::matches(Instruction instruction, const char *cmd, InstructionFormat format) const {
+    if (cmd == nullptr || (!mnemonic.empty() && mnemonic != cmd)) {
+        return false;
+    }
+    for (int field = 0; field < PATTERN_FIELDS; field++) {
+        const RegisterConstraint &constraint = registers[field];
+        if (!constraint.active) {
+            continue;
+        }
+        Register reg = (instruction >> FIELD_SHIFTS[field]) & 0b11111;
+        if (!has_field(format, field) || (reg == constraint.reg) == constraint.negate) {
+            return false;
+        }
+    }
+    Immediate immediate;
+    if (has_immediate && (!get_immediate(instruction, format, immediate) || immediate < low || immediate > high)) {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,62 @@
+#ifndef PATTERN_H
+#define PATTERN_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "riscvutil.h"
+#include "elfutil.h"
+#include "histogram.h"
+
+#define PATTERN_RD 0
+#define PATTERN_RS1 1
+#define PATTERN_RS2 2
+#define PATTERN_FIELDS 3
+
+
+// Returns the mnemonic and format of an instruction, nullptr if unknown
+typedef std::function<const char *(Instruction, InstructionFormat &)> CommandDecoder;
+
+
+struct PatternFilter {
+    Instruction mask;
+    Instruction value;
+};
+
+
+struct RegisterConstraint {
+    bool active = false;
+    bool negate = false;
+    Register reg = 0;
+};
+
+
+// A query over decoded instructions:
+//
+//     MNEMONIC|* [rd|rs1|rs2(=|!=)REG]... [imm=N|imm=LOW..HIGH]
+//
+// e.g. "lw rs1=sp", "ecall", "jalr rs1!=ra", "addi rd=sp imm=-64..-1".
+// The mnemonic and equal registers compile into a (mask, value) word filter
+// that is checked against the raw .text words; everything else is a
+// residual check run only on the words the filter lets through.
+class InstructionPattern {
+public:
+    bool compile(const char *text, const CommandDecoder &get_cmd);
+    void scan(const char *code, Elf32_Word size, std::vector<Elf32_Word> &candidates) const;
+    bool matches(Instruction instruction, const char *cmd, InstructionFormat format) const;
+private:
+    bool parse_constraint(const std::string &token);
+    bool find_encoding(const CommandDecoder &get_cmd, Instruction &instruction, InstructionFormat &format) const;
+
+    std::string mnemonic;
+    // Unset for "*", every word is then a candidate
+    bool has_filter = false;
+    PatternFilter filter = {0, 0};
+    RegisterConstraint registers[PATTERN_FIELDS];
+    bool has_immediate = false;
+    Immediate low = 0;
+    Immediate high = 0;
+};
+
+#endif
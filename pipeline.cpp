@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <cstring>
+
+#include "pipeline.h"
+
+
+OutputPipeline::OutputPipeline(FILE *file, BlockCompressor *compressor) : file(file), compressor(compressor) {
+    new_block();
+    writer = std::thread(&OutputPipeline::write_blocks, this);
+}
+
+
+OutputPipeline::~OutputPipeline() {
+    finish();
+}
+
+
+void OutputPipeline::new_block() {
+    block.data.reset(new char[PIPELINE_BLOCK_SIZE + PIPELINE_LINE_SIZE]);
+    block.size = 0;
+}
+
+
+void OutputPipeline::vprint(const char *format, va_list args) {
+    va_list copy;
+    va_copy(copy, args);
+    int length = vsnprintf(block.data.get() + block.size, PIPELINE_LINE_SIZE, format, args);
+    if (length < 0) {
+        format_error = true;
+    }
+    else if (length < PIPELINE_LINE_SIZE) {
+        block.size += length;
+    }
+    else {
+        flush_block();
+        std::unique_ptr<char[]> long_line(new char[length + 1]);
+        vsnprintf(long_line.get(), length + 1, format, copy);
+        block.data = std::move(long_line);
+        block.size = length;
+        flush_block();
+    }
+    va_end(copy);
+    if (block.size >= PIPELINE_BLOCK_SIZE) {
+        flush_block();
+    }
+}
+
+
+void OutputPipeline::write(const char *data, size_t size) {
+    while (size > 0) {
+        size_t chunk = std::min(size, (size_t) PIPELINE_BLOCK_SIZE - std::min(block.size, (size_t) PIPELINE_BLOCK_SIZE));
+        if (chunk == 0) {
+            flush_block();
+            continue;
+        }
+        memcpy(block.data.get() + block.size, data, chunk);
+        block.size += chunk;
+        data += chunk;
+        size -= chunk;
+        if (block.size >= PIPELINE_BLOCK_SIZE) {
+            flush_block();
+        }
+    }
+}
+
+
+void OutputPipeline::flush_block() {
+    if (block.size == 0) {
+        return;
+    }
+    while (!queue.push(std::move(block))) {
+        std::unique_lock<std::mutex> lock(mutex);
+        space_available.wait(lock, [this] { return !queue.full(); });
+    }
+    // Taking the mutex orders the push before a writer that is about to wait
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+    }
+    block_available.notify_one();
+    new_block();
+}
+
+
+void OutputPipeline::write_block(const OutputBlock &current) {
+    if (compressor != nullptr) {
+        compressor->write(current.data.get(), current.size);
+    }
+    else if (fwrite(current.data.get(), 1, current.size, file) != current.size) {
+        write_error = true;
+    }
+}
+
+
+void OutputPipeline::write_blocks() {
+    OutputBlock current;
+    while (true) {
+        if (queue.pop(current)) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+            }
+            space_available.notify_one();
+            write_block(current);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        block_available.wait(lock, [this] { return done || !queue.empty(); });
+        // done is only set after the last push
+        if (done && queue.empty()) {
+            break;
+        }
+    }
+    if (compressor != nullptr && !compressor->finish()) {
+        write_error = true;
+    }
+}
+
+
+bool OutputPipeline::finish() {
+    if (writer.joinable()) {
+        flush_block();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done = true;
+        }
+        block_available.notify_one();
+        writer.join();
+    }
+    return !format_error && !write_error;
+}
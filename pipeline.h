@@ -0,0 +1,56 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "compress.h"
+#include "spsc_queue.h"
+
+#define PIPELINE_BLOCK_SIZE (64 * 1024)
+#define PIPELINE_LINE_SIZE 256
+#define PIPELINE_QUEUE_SIZE 16
+
+
+struct OutputBlock {
+    std::unique_ptr<char[]> data;
+    size_t size = 0;
+};
+
+
+// Formatting runs on the calling thread and fills fixed-size blocks, a
+// writer thread compresses (if requested) and writes them. The bounded queue
+// between the two stages stalls the formatter when the writer falls behind;
+// either side sleeps on a condition variable while it has to wait.
+class OutputPipeline {
+public:
+    OutputPipeline(FILE *file, BlockCompressor *compressor);
+    ~OutputPipeline();
+    void vprint(const char *format, va_list args);
+    void write(const char *data, size_t size);
+    bool finish();
+private:
+    void new_block();
+    void flush_block();
+    void write_block(const OutputBlock &current);
+    void write_blocks();
+
+    FILE *file;
+    BlockCompressor *compressor;
+    OutputBlock block;
+    SpscQueue<OutputBlock> queue{PIPELINE_QUEUE_SIZE};
+    // Guards only the sleeping, the queue itself is lock-free
+    std::mutex mutex;
+    std::condition_variable block_available;
+    std::condition_variable space_available;
+    bool done = false;
+    std::thread writer;
+    bool format_error = false;
+    bool write_error = false;
+};
+
+#endif
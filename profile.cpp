@@ -0,0 +1,166 @@
+#include <algorithm>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "profile.h"
+
+
+static int get_digit(char c, int base) {
+    int digit;
+    if (c >= '0' && c <= '9') {
+        digit = c - '0';
+    }
+    else if (c >= 'a' && c <= 'f') {
+        digit = c - 'a' + 10;
+    }
+    else if (c >= 'A' && c <= 'F') {
+        digit = c - 'A' + 10;
+    }
+    else {
+        return -1;
+    }
+    return digit < base ? digit : -1;
+}
+
+
+static bool parse_number(const char *&ptr, const char *end, int base, uint64_t &value) {
+    if (base == 16 && end - ptr > 2 && ptr[0] == '0' && (ptr[1] == 'x' || ptr[1] == 'X')) {
+        ptr += 2;
+    }
+    const char *start = ptr;
+    value = 0;
+    bool overflow = false;
+    for (int digit; ptr < end && (digit = get_digit(*ptr, base)) != -1; ptr++) {
+        overflow |= __builtin_mul_overflow(value, (uint64_t) base, &value) || __builtin_add_overflow(value, (uint64_t) digit, &value);
+    }
+    return ptr != start && !overflow;
+}
+
+
+static void add_saturating(uint64_t &sum, uint64_t value) {
+    if (__builtin_add_overflow(sum, value, &sum)) {
+        sum = UINT64_MAX;
+    }
+}
+
+
+static void skip_blanks(const char *&ptr, const char *end) {
+    while (ptr < end && (*ptr == ' ' || *ptr == '\t' || *ptr == '\r')) {
+        ptr++;
+    }
+}
+
+
+bool Profile::parse(const char *ptr, const char *end) {
+    // Sums of counts saturate instead of wrapping
+    std::vector<ProfileSample> raw;
+    raw.reserve((end - ptr) / 12);
+    for (size_t line = 1; ptr < end; line++) {
+        skip_blanks(ptr, end);
+        if (ptr < end && *ptr != '\n' && *ptr != '#') {
+            uint64_t addr;
+            uint64_t count;
+            bool valid = parse_number(ptr, end, 16, addr);
+            skip_blanks(ptr, end);
+            valid = valid && parse_number(ptr, end, 10, count);
+            skip_blanks(ptr, end);
+            if (!valid || addr > UINT32_MAX || (ptr < end && *ptr != '\n' && *ptr != '#')) {
+                error_line = line;
+                return false;
+            }
+            raw.push_back({(Elf32_Addr) addr, count});
+        }
+        while (ptr < end && *ptr != '\n') {
+            ptr++;
+        }
+        ptr++;
+    }
+    std::sort(raw.begin(), raw.end(), [](const ProfileSample &a, const ProfileSample &b) {
+        return a.addr < b.addr;
+    });
+    for (const ProfileSample &sample : raw) {
+        if (!samples.empty() && samples.back().addr == sample.addr) {
+            add_saturating(samples.back().count, sample.count);
+        }
+        else {
+            samples.push_back(sample);
+        }
+        add_saturating(total, sample.count);
+    }
+    return true;
+}
+
+
+bool Profile::load(const char *file_name) {
+    int file = open(file_name, O_RDONLY);
+    if (file == -1) {
+        perror("Error. Couldn't open profile");
+        return false;
+    }
+    struct stat file_stat;
+    if (fstat(file, &file_stat) != 0) {
+        perror("Error. Couldn't stat profile");
+        close(file);
+        return false;
+    }
+    if (file_stat.st_size == 0) {
+        close(file);
+        return true;
+    }
+    void *mapping = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (mapping == MAP_FAILED) {
+        perror("Error. Couldn't map profile");
+        return false;
+    }
+    madvise(mapping, file_stat.st_size, MADV_SEQUENTIAL);
+    const char *data = (const char *) mapping;
+    bool result = parse(data, data + file_stat.st_size);
+    munmap(mapping, file_stat.st_size);
+    return result;
+}
+
+
+size_t Profile::get_error_line() const {
+    return error_line;
+}
+
+
+uint64_t Profile::get_total() const {
+    return total;
+}
+
+
+size_t Profile::find(Elf32_Addr addr) const {
+    return std::lower_bound(samples.begin(), samples.end(), addr, [](const ProfileSample &sample, Elf32_Addr addr) {
+        return sample.addr < addr;
+    }) - samples.begin();
+}
+
+
+size_t Profile::size() const {
+    return samples.size();
+}
+
+
+const ProfileSample & Profile::get_sample(size_t index) const {
+    return samples[index];
+}
+
+
+void Profile::sum_ranges(const std::vector<Elf32_Addr> &starts, Elf32_Addr end, std::vector<uint64_t> &totals) const {
+    totals.assign(starts.size(), 0);
+    if (starts.empty()) {
+        return;
+    }
+    size_t sample = find(starts[0]);
+    for (size_t i = 0; i < starts.size(); i++) {
+        Elf32_Addr range_end = i + 1 < starts.size() ? starts[i + 1] : end;
+        for (; sample < samples.size() && samples[sample].addr < range_end; sample++) {
+            add_saturating(totals[i], samples[sample].count);
+        }
+    }
+}
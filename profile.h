@@ -0,0 +1,43 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "elfutil.h"
+
+
+struct ProfileSample {
+    Elf32_Addr addr;
+    uint64_t count;
+};
+
+
+// PC samples read from a text file with one "ADDRESS COUNT" pair per line,
+// the address in hexadecimal and the count in decimal, up to 64 bits; '#'
+// starts a comment. Sums of counts saturate at UINT64_MAX.
+// Samples are sorted and samples of the same address merged once on load,
+// so callers walking .text in address order can join them with a cursor.
+class Profile {
+public:
+    bool load(const char *file_name);
+    // Line of the first malformed entry after load failed on one
+    size_t get_error_line() const;
+    uint64_t get_total() const;
+    // Index of the first sample at or after addr
+    size_t find(Elf32_Addr addr) const;
+    size_t size() const;
+    const ProfileSample & get_sample(size_t index) const;
+    // Sums samples over [starts[i], starts[i + 1]), the last range ending
+    // at end; starts must be sorted
+    void sum_ranges(const std::vector<Elf32_Addr> &starts, Elf32_Addr end, std::vector<uint64_t> &totals) const;
+private:
+    bool parse(const char *ptr, const char *end);
+
+    std::vector<ProfileSample> samples;
+    uint64_t total = 0;
+    size_t error_line = 0;
+};
+
+#endif
@@ -0,0 +1,540 @@
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+
+#include "riscvext.h"
+
+
+static constexpr ExtensionTable<
+#ifndef DISASM_NO_EXT_ZICSR
+    ZicsrExtension,
+#endif
+#ifndef DISASM_NO_EXT_A
+    AtomicExtension,
+#endif
+#ifndef DISASM_NO_EXT_FD
+    FloatExtension,
+#endif
+#ifndef DISASM_NO_EXT_ZB
+    BitmanipExtension,
+#endif
+    NoExtension> extension_table{};
+
+
+const char * const FREG_ABI[] = {
+    "ft0",
+    "ft1",
+    "ft2",
+    "ft3",
+    "ft4",
+    "ft5",
+    "ft6",
+    "ft7",
+    "fs0",
+    "fs1",
+    "fa0",
+    "fa1",
+    "fa2",
+    "fa3",
+    "fa4",
+    "fa5",
+    "fa6",
+    "fa7",
+    "fs2",
+    "fs3",
+    "fs4",
+    "fs5",
+    "fs6",
+    "fs7",
+    "fs8",
+    "fs9",
+    "fs10",
+    "fs11",
+    "ft8",
+    "ft9",
+    "ft10",
+    "ft11",
+};
+
+
+static const char * get_freg_name(Register reg) {
+    return FREG_ABI[reg];
+}
+
+
+static Register get_rs3(Instruction instruction) {
+    return instruction >> 27;
+}
+
+
+static const char * get_csr_name(uint16_t csr) {
+    switch (csr) {
+        case 0x001:
+            return "fflags";
+        case 0x002:
+            return "frm";
+        case 0x003:
+            return "fcsr";
+        case 0x300:
+            return "mstatus";
+        case 0x301:
+            return "misa";
+        case 0x304:
+            return "mie";
+        case 0x305:
+            return "mtvec";
+        case 0x340:
+            return "mscratch";
+        case 0x341:
+            return "mepc";
+        case 0x342:
+            return "mcause";
+        case 0x343:
+            return "mtval";
+        case 0x344:
+            return "mip";
+        case 0xc00:
+            return "cycle";
+        case 0xc01:
+            return "time";
+        case 0xc02:
+            return "instret";
+        case 0xc80:
+            return "cycleh";
+        case 0xc81:
+            return "timeh";
+        case 0xc82:
+            return "instreth";
+        case 0xf14:
+            return "mhartid";
+        default:
+            return nullptr;
+    }
+}
+
+
+const char * ZicsrExtension::decode(Instruction instruction, Extensions, char *operands, size_t size) {
+    static const char * const CMD[] = {nullptr, "csrrw", "csrrs", "csrrc", nullptr, "csrrwi", "csrrsi", "csrrci"};
+    Funct3 funct3 = get_funct3(instruction);
+    const char *cmd = CMD[funct3];
+    if (cmd == nullptr) {
+        return nullptr;
+    }
+    uint16_t csr = get_funct12(instruction);
+    char csr_name[8];
+    const char *name = get_csr_name(csr);
+    if (name == nullptr) {
+        snprintf(csr_name, sizeof(csr_name), "0x%03x", csr);
+        name = csr_name;
+    }
+    if (funct3 & 0b100) {
+        snprintf(operands, size, "%s, %s, %d", get_reg_name(get_rd(instruction)), name, get_rs1(instruction));
+    }
+    else {
+        snprintf(operands, size, "%s, %s, %s", get_reg_name(get_rd(instruction)), name, get_reg_name(get_rs1(instruction)));
+    }
+    return cmd;
+}
+
+
+#define AMO_CMD(name) {name, name ".rl", name ".aq", name ".aqrl"}
+
+const char * AtomicExtension::decode(Instruction instruction, Extensions, char *operands, size_t size) {
+    static const char * const CMD[32][4] = {
+        AMO_CMD("amoadd.w"),
+        AMO_CMD("amoswap.w"),
+        AMO_CMD("lr.w"),
+        AMO_CMD("sc.w"),
+        AMO_CMD("amoxor.w"),
+        {}, {}, {},
+        AMO_CMD("amoor.w"),
+        {}, {}, {},
+        AMO_CMD("amoand.w"),
+        {}, {}, {},
+        AMO_CMD("amomin.w"),
+        {}, {}, {},
+        AMO_CMD("amomax.w"),
+        {}, {}, {},
+        AMO_CMD("amominu.w"),
+        {}, {}, {},
+        AMO_CMD("amomaxu.w"),
+        {}, {}, {},
+    };
+    if (get_funct3(instruction) != 0b010) {
+        return nullptr;
+    }
+    uint8_t funct5 = instruction >> 27;
+    const char *cmd = CMD[funct5][(instruction >> 25) & 0b11];
+    if (cmd == nullptr) {
+        return nullptr;
+    }
+    const char *rd = get_reg_name(get_rd(instruction));
+    const char *rs1 = get_reg_name(get_rs1(instruction));
+    if (funct5 == 0b00010) {
+        if (get_rs2(instruction) != 0) {
+            return nullptr;
+        }
+        snprintf(operands, size, "%s, (%s)", rd, rs1);
+    }
+    else {
+        snprintf(operands, size, "%s, %s, (%s)", rd, get_reg_name(get_rs2(instruction)), rs1);
+    }
+    return cmd;
+}
+
+
+static const char * decode_fp_op(Instruction instruction, bool is_double, char *operands, size_t size) {
+    Funct3 funct3 = get_funct3(instruction);
+    Register rs2 = get_rs2(instruction);
+    const char *frd = get_freg_name(get_rd(instruction));
+    const char *frs1 = get_freg_name(get_rs1(instruction));
+    const char *frs2 = get_freg_name(rs2);
+    const char *rd = get_reg_name(get_rd(instruction));
+    const char *rs1 = get_reg_name(get_rs1(instruction));
+    switch (get_funct7(instruction) >> 2) {
+        case 0b00000:
+            snprintf(operands, size, "%s, %s, %s", frd, frs1, frs2);
+            return is_double ? "fadd.d" : "fadd.s";
+        case 0b00001:
+            snprintf(operands, size, "%s, %s, %s", frd, frs1, frs2);
+            return is_double ? "fsub.d" : "fsub.s";
+        case 0b00010:
+            snprintf(operands, size, "%s, %s, %s", frd, frs1, frs2);
+            return is_double ? "fmul.d" : "fmul.s";
+        case 0b00011:
+            snprintf(operands, size, "%s, %s, %s", frd, frs1, frs2);
+            return is_double ? "fdiv.d" : "fdiv.s";
+        case 0b01011:
+            if (rs2 != 0) {
+                return nullptr;
+            }
+            snprintf(operands, size, "%s, %s", frd, frs1);
+            return is_double ? "fsqrt.d" : "fsqrt.s";
+        case 0b00100:
+        {
+            static const char * const CMD[2][3] = {{"fsgnj.s", "fsgnjn.s", "fsgnjx.s"}, {"fsgnj.d", "fsgnjn.d", "fsgnjx.d"}};
+            if (funct3 > 0b010) {
+                return nullptr;
+            }
+            snprintf(operands, size, "%s, %s, %s", frd, frs1, frs2);
+            return CMD[is_double][funct3];
+        }
+        case 0b00101:
+        {
+            static const char * const CMD[2][2] = {{"fmin.s", "fmax.s"}, {"fmin.d", "fmax.d"}};
+            if (funct3 > 0b001) {
+                return nullptr;
+            }
+            snprintf(operands, size, "%s, %s, %s", frd, frs1, frs2);
+            return CMD[is_double][funct3];
+        }
+        case 0b01000:
+            snprintf(operands, size, "%s, %s", frd, frs1);
+            if (is_double && rs2 == 0) {
+                return "fcvt.d.s";
+            }
+            if (!is_double && rs2 == 1) {
+                return "fcvt.s.d";
+            }
+            return nullptr;
+        case 0b10100:
+        {
+            static const char * const CMD[2][3] = {{"fle.s", "flt.s", "feq.s"}, {"fle.d", "flt.d", "feq.d"}};
+            if (funct3 > 0b010) {
+                return nullptr;
+            }
+            snprintf(operands, size, "%s, %s, %s", rd, frs1, frs2);
+            return CMD[is_double][funct3];
+        }
+        case 0b11000:
+        {
+            static const char * const CMD[2][2] = {{"fcvt.w.s", "fcvt.wu.s"}, {"fcvt.w.d", "fcvt.wu.d"}};
+            if (rs2 > 1) {
+                return nullptr;
+            }
+            snprintf(operands, size, "%s, %s", rd, frs1);
+            return CMD[is_double][rs2];
+        }
+        case 0b11010:
+        {
+            static const char * const CMD[2][2] = {{"fcvt.s.w", "fcvt.s.wu"}, {"fcvt.d.w", "fcvt.d.wu"}};
+            if (rs2 > 1) {
+                return nullptr;
+            }
+            snprintf(operands, size, "%s, %s", frd, rs1);
+            return CMD[is_double][rs2];
+        }
+        case 0b11100:
+            if (rs2 != 0) {
+                return nullptr;
+            }
+            snprintf(operands, size, "%s, %s", rd, frs1);
+            if (funct3 == 0b001) {
+                return is_double ? "fclass.d" : "fclass.s";
+            }
+            return funct3 == 0b000 && !is_double ? "fmv.x.w" : nullptr;
+        case 0b11110:
+            if (rs2 != 0 || funct3 != 0b000 || is_double) {
+                return nullptr;
+            }
+            snprintf(operands, size, "%s, %s", frd, rs1);
+            return "fmv.w.x";
+        default:
+            return nullptr;
+    }
+}
+
+
+bool has_reserved_rounding_mode(Instruction instruction) {
+    Opcode opcode = instruction & 0b1111111;
+    Funct3 rounding_mode = get_funct3(instruction);
+    if (rounding_mode != 0b101 && rounding_mode != 0b110) {
+        return false;
+    }
+    if (opcode == MADD || opcode == MSUB || opcode == NMSUB || opcode == NMADD) {
+        return true;
+    }
+    if (opcode != OP_FP) {
+        return false;
+    }
+    // Elsewhere funct3 selects the operation
+    switch (get_funct7(instruction) >> 2) {
+        case 0b00000:
+        case 0b00001:
+        case 0b00010:
+        case 0b00011:
+        case 0b01011:
+        case 0b01000:
+        case 0b11000:
+        case 0b11010:
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+const char * FloatExtension::decode(Instruction instruction, Extensions enabled, char *operands, size_t size) {
+    Opcode opcode = instruction & 0b1111111;
+    Funct3 funct3 = get_funct3(instruction);
+    bool is_double;
+    if (opcode == LOAD_FP || opcode == STORE_FP) {
+        if (funct3 != 0b010 && funct3 != 0b011) {
+            return nullptr;
+        }
+        is_double = funct3 == 0b011;
+    }
+    else {
+        // fmt field, only S (00) and D (01) are supported
+        uint8_t fmt = (instruction >> 25) & 0b11;
+        if (fmt > 0b01) {
+            return nullptr;
+        }
+        is_double = fmt == 0b01;
+    }
+    if (!(enabled & (is_double ? EXT_D : EXT_F))) {
+        return nullptr;
+    }
+    switch (opcode) {
+        case LOAD_FP:
+            snprintf(operands, size, "%s, %d(%s)", get_freg_name(get_rd(instruction)), get_i_immediate(instruction), get_reg_name(get_rs1(instruction)));
+            return is_double ? "fld" : "flw";
+        case STORE_FP:
+            snprintf(operands, size, "%s, %d(%s)", get_freg_name(get_rs2(instruction)), get_s_immediate(instruction), get_reg_name(get_rs1(instruction)));
+            return is_double ? "fsd" : "fsw";
+        case MADD:
+        case MSUB:
+        case NMSUB:
+        case NMADD:
+        {
+            static const char * const CMD[2][4] = {{"fmadd.s", "fmsub.s", "fnmsub.s", "fnmadd.s"}, {"fmadd.d", "fmsub.d", "fnmsub.d", "fnmadd.d"}};
+            snprintf(operands, size, "%s, %s, %s, %s", get_freg_name(get_rd(instruction)), get_freg_name(get_rs1(instruction)), get_freg_name(get_rs2(instruction)), get_freg_name(get_rs3(instruction)));
+            return CMD[is_double][(opcode >> 2) & 0b11];
+        }
+        case OP_FP:
+            return decode_fp_op(instruction, is_double, operands, size);
+        default:
+            return nullptr;
+    }
+}
+
+
+static const char * decode_zba_zbb_op(Instruction instruction, Extensions enabled) {
+    Funct7 funct7 = get_funct7(instruction);
+    Funct3 funct3 = get_funct3(instruction);
+    if (enabled & EXT_ZBA) {
+        if (funct7 == 0b0010000 && funct3 == 0b010) {
+            return "sh1add";
+        }
+        else if (funct7 == 0b0010000 && funct3 == 0b100) {
+            return "sh2add";
+        }
+        else if (funct7 == 0b0010000 && funct3 == 0b110) {
+            return "sh3add";
+        }
+    }
+    if (enabled & EXT_ZBB) {
+        if (funct7 == 0b0100000 && funct3 == 0b111) {
+            return "andn";
+        }
+        else if (funct7 == 0b0100000 && funct3 == 0b110) {
+            return "orn";
+        }
+        else if (funct7 == 0b0100000 && funct3 == 0b100) {
+            return "xnor";
+        }
+        else if (funct7 == 0b0000101 && funct3 == 0b100) {
+            return "min";
+        }
+        else if (funct7 == 0b0000101 && funct3 == 0b101) {
+            return "minu";
+        }
+        else if (funct7 == 0b0000101 && funct3 == 0b110) {
+            return "max";
+        }
+        else if (funct7 == 0b0000101 && funct3 == 0b111) {
+            return "maxu";
+        }
+        else if (funct7 == 0b0110000 && funct3 == 0b001) {
+            return "rol";
+        }
+        else if (funct7 == 0b0110000 && funct3 == 0b101) {
+            return "ror";
+        }
+    }
+    return nullptr;
+}
+
+
+static const char * decode_zbb_op_imm(Instruction instruction) {
+    Funct3 funct3 = get_funct3(instruction);
+    uint16_t funct12 = get_funct12(instruction);
+    if (funct3 == 0b001) {
+        switch (funct12) {
+            case 0x600:
+                return "clz";
+            case 0x601:
+                return "ctz";
+            case 0x602:
+                return "cpop";
+            case 0x604:
+                return "sext.b";
+            case 0x605:
+                return "sext.h";
+            default:
+                return nullptr;
+        }
+    }
+    else if (funct3 == 0b101) {
+        switch (funct12) {
+            case 0x287:
+                return "orc.b";
+            case 0x698:
+                return "rev8";
+            default:
+                return nullptr;
+        }
+    }
+    return nullptr;
+}
+
+
+const char * BitmanipExtension::decode(Instruction instruction, Extensions enabled, char *operands, size_t size) {
+    const char *rd = get_reg_name(get_rd(instruction));
+    const char *rs1 = get_reg_name(get_rs1(instruction));
+    const char *cmd;
+    if ((instruction & 0b1111111) == OP) {
+        if ((enabled & EXT_ZBB) && get_funct7(instruction) == 0b0000100 && get_funct3(instruction) == 0b100 && get_rs2(instruction) == 0) {
+            snprintf(operands, size, "%s, %s", rd, rs1);
+            return "zext.h";
+        }
+        cmd = decode_zba_zbb_op(instruction, enabled);
+        if (cmd != nullptr) {
+            snprintf(operands, size, "%s, %s, %s", rd, rs1, get_reg_name(get_rs2(instruction)));
+        }
+        return cmd;
+    }
+    if (!(enabled & EXT_ZBB)) {
+        return nullptr;
+    }
+    if (get_funct7(instruction) == 0b0110000 && get_funct3(instruction) == 0b101) {
+        snprintf(operands, size, "%s, %s, %d", rd, rs1, get_shamt(instruction));
+        return "rori";
+    }
+    cmd = decode_zbb_op_imm(instruction);
+    if (cmd != nullptr) {
+        snprintf(operands, size, "%s, %s", rd, rs1);
+    }
+    return cmd;
+}
+
+
+const char * decode_extension(Instruction instruction, Extensions enabled, char *operands, size_t size) {
+    const ExtensionEntry &entry = extension_table.entries[instruction & 0b1111111];
+    for (size_t i = 0; i < entry.count; i++) {
+        if (entry.ids[i] & enabled) {
+            const char *cmd = entry.decoders[i](instruction, enabled, operands, size);
+            if (cmd != nullptr) {
+                return cmd;
+            }
+        }
+    }
+    return nullptr;
+}
+
+
+Extensions parse_arch(const char *arch) {
+    if (strncmp(arch, "rv32", 4) != 0 && strncmp(arch, "rv64", 4) != 0) {
+        return EXT_ALL;
+    }
+    Extensions extensions = 0;
+    const char *ptr = arch + 4;
+    while (*ptr != '\0') {
+        if (*ptr == '_') {
+            ptr++;
+            continue;
+        }
+        if (*ptr == 'z' || *ptr == 'x' || *ptr == 's') {
+            const char *end = ptr;
+            while (*end != '\0' && *end != '_') {
+                end++;
+            }
+            // strip the version suffix, e.g. "zicsr2p0"
+            const char *name_end = end;
+            while (name_end > ptr && (isdigit(name_end[-1]) || (name_end[-1] == 'p' && isdigit(name_end[-2])))) {
+                name_end--;
+            }
+            size_t length = name_end - ptr;
+            if (length == 5 && strncmp(ptr, "zicsr", 5) == 0) {
+                extensions |= EXT_ZICSR;
+            }
+            else if (length == 3 && strncmp(ptr, "zba", 3) == 0) {
+                extensions |= EXT_ZBA;
+            }
+            else if (length == 3 && strncmp(ptr, "zbb", 3) == 0) {
+                extensions |= EXT_ZBB;
+            }
+            ptr = end;
+            continue;
+        }
+        switch (*ptr) {
+            case 'a':
+                extensions |= EXT_A;
+                break;
+            case 'f':
+                extensions |= EXT_F | EXT_ZICSR;
+                break;
+            case 'd':
+                extensions |= EXT_F | EXT_D | EXT_ZICSR;
+                break;
+            case 'g':
+                extensions |= EXT_A | EXT_F | EXT_D | EXT_ZICSR;
+                break;
+        }
+        ptr++;
+        while (isdigit(*ptr) || (*ptr == 'p' && isdigit(ptr[1]))) {
+            ptr++;
+        }
+    }
+    return extensions;
+}
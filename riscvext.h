@@ -0,0 +1,118 @@
+#ifndef RISCVEXT_H
+#define RISCVEXT_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "riscvutil.h"
+
+#define LOAD_FP 0b0000111
+#define STORE_FP 0b0100111
+#define AMO 0b0101111
+#define MADD 0b1000011
+#define MSUB 0b1000111
+#define NMSUB 0b1001011
+#define NMADD 0b1001111
+#define OP_FP 0b1010011
+
+#define EXT_A 0x1
+#define EXT_F 0x2
+#define EXT_D 0x4
+#define EXT_ZICSR 0x8
+#define EXT_ZBA 0x10
+#define EXT_ZBB 0x20
+#define EXT_ALL 0x3f
+
+#define EXT_OPCODES 128
+#define EXT_DECODERS_PER_OPCODE 4
+
+
+typedef uint32_t Extensions;
+
+// Decodes one instruction of an extension. Writes the operands into the
+// buffer and returns the mnemonic, or nullptr if the instruction is not
+// part of the extension. Instructions belonging to only some of the
+// extensions a module covers are checked against the enabled set.
+typedef const char * (*ExtensionDecoder)(Instruction instruction, Extensions enabled, char *operands, size_t size);
+
+
+struct ZicsrExtension {
+    static constexpr Extensions id = EXT_ZICSR;
+    static constexpr Opcode opcodes[] = {SYSTEM};
+    static const char * decode(Instruction instruction, Extensions enabled, char *operands, size_t size);
+};
+
+
+struct AtomicExtension {
+    static constexpr Extensions id = EXT_A;
+    static constexpr Opcode opcodes[] = {AMO};
+    static const char * decode(Instruction instruction, Extensions enabled, char *operands, size_t size);
+};
+
+
+struct FloatExtension {
+    static constexpr Extensions id = EXT_F | EXT_D;
+    static constexpr Opcode opcodes[] = {LOAD_FP, STORE_FP, MADD, MSUB, NMSUB, NMADD, OP_FP};
+    static const char * decode(Instruction instruction, Extensions enabled, char *operands, size_t size);
+};
+
+
+struct BitmanipExtension {
+    static constexpr Extensions id = EXT_ZBA | EXT_ZBB;
+    static constexpr Opcode opcodes[] = {OP, OP_IMM};
+    static const char * decode(Instruction instruction, Extensions enabled, char *operands, size_t size);
+};
+
+
+// Terminates the module list, registers nothing.
+struct NoExtension {
+    static constexpr Extensions id = 0;
+    static constexpr Opcode opcodes[] = {0};
+    static const char * decode(Instruction, Extensions, char *, size_t) {
+        return nullptr;
+    }
+};
+
+
+struct ExtensionEntry {
+    size_t count = 0;
+    Extensions ids[EXT_DECODERS_PER_OPCODE] = {};
+    ExtensionDecoder decoders[EXT_DECODERS_PER_OPCODE] = {};
+};
+
+
+// Opcode-indexed dispatch table filled at compile time from the list of
+// modules built into the binary.
+template <class... Modules>
+struct ExtensionTable {
+    ExtensionEntry entries[EXT_OPCODES];
+
+    constexpr ExtensionTable() : entries{} {
+        (add<Modules>(), ...);
+    }
+
+    template <class Module>
+    constexpr void add() {
+        if (Module::id == 0) {
+            return;
+        }
+        for (Opcode opcode : Module::opcodes) {
+            ExtensionEntry &entry = entries[opcode];
+            entry.ids[entry.count] = Module::id;
+            entry.decoders[entry.count] = &Module::decode;
+            entry.count++;
+        }
+    }
+};
+
+// Called only for words the base ISA decoder rejected; returns nullptr
+// without touching any decoder if no enabled module handles the opcode.
+const char * decode_extension(Instruction instruction, Extensions enabled, char *operands, size_t size);
+
+// True for F and D instructions with the reserved rounding modes 101 and 110,
+// which objdump still decodes and prints as "unknown"
+bool has_reserved_rounding_mode(Instruction instruction);
+
+Extensions parse_arch(const char *arch);
+
+#endif
@@ -16,6 +16,12 @@
 #define BRANCH 0b1100011
 #define SYSTEM 0b1110011
 
+#define REG_ZERO 0
+#define REG_RA 1
+#define REG_SP 2
+#define REG_GP 3
+#define REG_TP 4
+
 #define PRIV 0b000
 #define ECALL 0b000000000000
 #define EBREAK 0b000000000001
@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "server.h"
+
+
+DisasmServer::DisasmServer(const char *socket_path, size_t cache_capacity, const DisasmOptions &options)
+    : socket_path(socket_path), cache_capacity(cache_capacity == 0 ? 1 : cache_capacity), options(options) {}
+
+
+bool DisasmServer::run() {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Error. Socket path is too long\n");
+        return false;
+    }
+    strcpy(address.sun_path, socket_path.c_str());
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server == -1) {
+        perror("Error. Couldn't create socket");
+        return false;
+    }
+    unlink(socket_path.c_str());
+    if (bind(server, (sockaddr *) &address, sizeof(address)) != 0 || listen(server, SOMAXCONN) != 0) {
+        perror("Error. Couldn't listen on socket");
+        close(server);
+        return false;
+    }
+    // A client that disconnects early makes writes fail with EPIPE instead
+    // of killing the server
+    signal(SIGPIPE, SIG_IGN);
+    unsigned threads = options.threads != 0 ? options.threads : std::thread::hardware_concurrency();
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < std::max(1u, threads); i++) {
+        workers.emplace_back(&DisasmServer::serve_clients, this);
+    }
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(clients_mutex);
+            client_taken.wait(lock, [this] { return clients.size() < SERVER_MAX_PENDING; });
+        }
+        int client = accept(server, nullptr, nullptr);
+        if (client == -1) {
+            perror("Error. Couldn't accept connection");
+            continue;
+        }
+        timeval timeout{SERVER_TIMEOUT_SECONDS, 0};
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        {
+            std::lock_guard<std::mutex> lock(clients_mutex);
+            clients.push_back(client);
+        }
+        client_ready.notify_one();
+    }
+}
+
+
+void DisasmServer::serve_clients() {
+    while (true) {
+        int client;
+        {
+            std::unique_lock<std::mutex> lock(clients_mutex);
+            client_ready.wait(lock, [this] { return !clients.empty(); });
+            client = clients.front();
+            clients.pop_front();
+        }
+        client_taken.notify_one();
+        handle_client(client);
+    }
+}
+
+
+std::shared_ptr<const CachedImage> DisasmServer::get_image(const std::string &path) {
+    struct stat file_stat;
+    if (stat(path.c_str(), &file_stat) != 0) {
+        return nullptr;
+    }
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        auto it = cache.find(path);
+        if (it != cache.end()) {
+            const timespec &mtime = it->second.first->mtime;
+            if (mtime.tv_sec == file_stat.st_mtim.tv_sec && mtime.tv_nsec == file_stat.st_mtim.tv_nsec) {
+                lru.splice(lru.begin(), lru, it->second.second);
+                return it->second.first;
+            }
+            lru.erase(it->second.second);
+            cache.erase(it);
+        }
+    }
+    std::shared_ptr<CachedImage> image = std::make_shared<CachedImage>(options);
+    if (!image->disasm.load(path.c_str())) {
+        return nullptr;
+    }
+    image->mtime = file_stat.st_mtim;
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto it = cache.find(path);
+    if (it != cache.end()) {
+        lru.erase(it->second.second);
+        cache.erase(it);
+    }
+    lru.push_front(path);
+    cache[path] = {image, lru.begin()};
+    while (cache.size() > cache_capacity) {
+        cache.erase(lru.back());
+        lru.pop_back();
+    }
+    return image;
+}
+
+
+void DisasmServer::handle_client(int client) {
+    char request[4096];
+    size_t length = 0;
+    while (length < sizeof(request) - 1) {
+        ssize_t count = read(client, request + length, sizeof(request) - 1 - length);
+        if (count <= 0) {
+            break;
+        }
+        length += count;
+        if (memchr(request, '\n', length) != nullptr) {
+            break;
+        }
+    }
+    request[length] = '\0';
+    FILE *output = fdopen(client, "w");
+    if (output == nullptr) {
+        close(client);
+        return;
+    }
+    char command[16];
+    char path[2048];
+    char argument[1024];
+    unsigned begin;
+    unsigned end;
+    int argument_begin = 0;
+    int fields = sscanf(request, "%15s %2047s %n%1023s %x", command, path, &argument_begin, argument, &end);
+    if (fields >= 3 && strcmp(command, "range") != 0) {
+        // Names run to the end of the line, demangled ones contain spaces
+        const char *name = request + argument_begin;
+        size_t name_length = strcspn(name, "\r\n");
+        while (name_length > 0 && name[name_length - 1] == ' ') {
+            name_length--;
+        }
+        if (name_length < sizeof(argument)) {
+            memcpy(argument, name, name_length);
+            argument[name_length] = '\0';
+        }
+    }
+    std::shared_ptr<const CachedImage> image = fields >= 3 ? get_image(path) : nullptr;
+    QueryStatus status = QueryStatus::OK;
+    if (fields < 3) {
+        fprintf(output, "Error. Invalid request\n");
+    }
+    else if (image == nullptr) {
+        fprintf(output, "Error. Couldn't load %s\n", path);
+    }
+    else if (strcmp(command, "range") == 0 && fields == 4) {
+        begin = strtoul(argument, nullptr, 16);
+        status = image->disasm.print_range(output, begin, end);
+    }
+    else if (strcmp(command, "function") == 0) {
+        status = image->disasm.print_function(output, argument);
+    }
+    else if (strcmp(command, "symbol") == 0) {
+        status = image->disasm.print_symbol(output, argument);
+    }
+    else {
+        fprintf(output, "Error. Unknown request %s\n", command);
+    }
+    if (status == QueryStatus::NOT_FOUND) {
+        fprintf(output, "Error. %s not found\n", argument);
+    }
+    int write_errno = status == QueryStatus::WRITE_ERROR || ferror(output) ? errno : 0;
+    if (fclose(output) != 0 && write_errno == 0) {
+        write_errno = errno;
+    }
+    // A client that went away only ends its own request
+    if (write_errno != 0 && write_errno != EPIPE && write_errno != ECONNRESET) {
+        fprintf(stderr, "Error. Couldn't write response: %s\n", strerror(write_errno));
+    }
+}
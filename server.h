@@ -0,0 +1,56 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <condition_variable>
+#include <ctime>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "disasm.h"
+
+#define SERVER_MAX_PENDING 64
+#define SERVER_TIMEOUT_SECONDS 10
+
+
+// Only read after loading, so queries against the same image run in parallel
+struct CachedImage {
+    explicit CachedImage(const DisasmOptions &options) : disasm(options) {}
+    Disasm disasm;
+    timespec mtime;
+};
+
+
+// Serves queries over a Unix domain socket, one request line per connection:
+//   range PATH BEGIN END
+//   function PATH NAME
+//   symbol PATH NAME
+// NAME runs to the end of the line and may be raw or demangled.
+// Parsed images are kept in an LRU cache keyed by path and modification time.
+// Connections are handled by a fixed number of workers; accepting stops while
+// SERVER_MAX_PENDING connections wait for one.
+class DisasmServer {
+public:
+    DisasmServer(const char *socket_path, size_t cache_capacity, const DisasmOptions &options);
+    bool run();
+private:
+    void serve_clients();
+    void handle_client(int client);
+    std::shared_ptr<const CachedImage> get_image(const std::string &path);
+
+    std::string socket_path;
+    size_t cache_capacity;
+    DisasmOptions options;
+    std::mutex cache_mutex;
+    std::list<std::string> lru;
+    std::unordered_map<std::string, std::pair<std::shared_ptr<const CachedImage>, std::list<std::string>::iterator>> cache;
+    std::mutex clients_mutex;
+    std::condition_variable client_ready;
+    std::condition_variable client_taken;
+    std::deque<int> clients;
+};
+
+#endif
@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <numeric>
+
+#include "stack.h"
+
+#define STATE_NEW 0
+#define STATE_ACTIVE 1
+#define STATE_DONE 2
+
+
+void StackAnalysis::add_function(Elf32_Addr begin, Elf32_Word size, const char *name) {
+    begins.push_back(begin);
+    ends.push_back(begin + size);
+    names.push_back(name);
+}
+
+
+void StackAnalysis::start() {
+    std::vector<size_t> order(begins.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+        return begins[a] < begins[b];
+    });
+    // Aliases share one entry keyed by address, named after all of them
+    std::vector<Elf32_Addr> sorted_begins;
+    std::vector<Elf32_Addr> sorted_ends;
+    std::vector<std::string> sorted_names;
+    for (size_t i : order) {
+        if (!sorted_begins.empty() && sorted_begins.back() == begins[i]) {
+            sorted_ends.back() = std::max(sorted_ends.back(), ends[i]);
+            sorted_names.back() += ", ";
+            sorted_names.back() += names[i];
+            continue;
+        }
+        sorted_begins.push_back(begins[i]);
+        sorted_ends.push_back(ends[i]);
+        sorted_names.push_back(std::move(names[i]));
+    }
+    begins.swap(sorted_begins);
+    ends.swap(sorted_ends);
+    names.swap(sorted_names);
+    size_t count = begins.size();
+    frames.assign(count, 0);
+    has_frame.assign(count, 0);
+    leaves.assign(count, 1);
+    entries.assign(count, 1);
+    indirect.assign(count, 0);
+    cursor = 0;
+}
+
+
+void StackAnalysis::visit(Elf32_Addr addr, Instruction instruction) {
+    while (cursor < begins.size() && ends[cursor] <= addr) {
+        cursor++;
+    }
+    if (cursor == begins.size() || addr < begins[cursor]) {
+        return;
+    }
+    Opcode opcode = instruction & 0b1111111;
+    Register rd = get_rd(instruction);
+    if (opcode == OP_IMM && get_funct3(instruction) == 0b000 && rd == REG_SP && get_rs1(instruction) == REG_SP) {
+        Immediate immediate = get_i_immediate(instruction);
+        if (immediate < 0 && !has_frame[cursor]) {
+            frames[cursor] = -immediate;
+            has_frame[cursor] = 1;
+        }
+    }
+    else if (opcode == JAL && (rd == REG_RA || rd == REG_ZERO)) {
+        Elf32_Addr target = addr + get_j_immediate(instruction);
+        if (rd == REG_RA) {
+            leaves[cursor] = 0;
+            calls.emplace_back(cursor, target);
+        }
+        else if (target < begins[cursor] || target >= ends[cursor]) {
+            // tail call, counted on top of the caller's frame to stay conservative
+            calls.emplace_back(cursor, target);
+        }
+    }
+    else if (opcode == JALR && rd == REG_RA) {
+        leaves[cursor] = 0;
+        indirect[cursor] = 1;
+    }
+}
+
+
+size_t StackAnalysis::find_function(Elf32_Addr addr) const {
+    auto it = std::lower_bound(begins.begin(), begins.end(), addr);
+    if (it == begins.end() || *it != addr) {
+        return begins.size();
+    }
+    return it - begins.begin();
+}
+
+
+void StackAnalysis::finish(Elf32_Addr entry) {
+    size_t count = begins.size();
+    std::sort(calls.begin(), calls.end());
+    edge_begins.assign(count + 1, 0);
+    edges.clear();
+    size_t call = 0;
+    for (size_t function = 0; function < count; function++) {
+        edge_begins[function] = edges.size();
+        for (; call < calls.size() && calls[call].first == function; call++) {
+            size_t callee = find_function(calls[call].second);
+            if (callee == count) {
+                indirect[function] = 1;
+                continue;
+            }
+            entries[callee] = 0;
+            edges.push_back(callee);
+        }
+    }
+    edge_begins[count] = edges.size();
+    size_t entry_function = find_function(entry);
+    if (entry_function != count) {
+        entries[entry_function] = 1;
+    }
+    depths.assign(count, 0);
+    states.assign(count, STATE_NEW);
+    for (size_t function = 0; function < count; function++) {
+        compute_depth(function);
+    }
+}
+
+
+// Depth-first over the call graph with an explicit stack, so long call chains
+// can't overflow the native one. A callee is pushed while its caller's edge
+// still points at it and is merged once it is done.
+void StackAnalysis::compute_depth(size_t root) {
+    struct Frame {
+        uint32_t function;
+        uint32_t edge;
+        uint32_t deepest;
+    };
+    if (states[root] != STATE_NEW) {
+        return;
+    }
+    std::vector<Frame> stack;
+    states[root] = STATE_ACTIVE;
+    stack.push_back({(uint32_t) root, edge_begins[root], 0});
+    while (!stack.empty()) {
+        Frame &frame = stack.back();
+        uint32_t function = frame.function;
+        if (frame.deepest != STACK_UNBOUNDED && frame.edge < edge_begins[function + 1]) {
+            uint32_t callee = edges[frame.edge];
+            if (states[callee] == STATE_NEW) {
+                states[callee] = STATE_ACTIVE;
+                stack.push_back({callee, edge_begins[callee], 0});
+                continue;
+            }
+            frame.edge++;
+            uint32_t depth = states[callee] == STATE_ACTIVE ? STACK_UNBOUNDED : depths[callee];
+            if (depth == STACK_UNBOUNDED) {
+                frame.deepest = STACK_UNBOUNDED;
+                continue;
+            }
+            if (indirect[callee]) {
+                indirect[function] = 1;
+            }
+            frame.deepest = std::max(frame.deepest, depth);
+            continue;
+        }
+        depths[function] = frame.deepest == STACK_UNBOUNDED ? STACK_UNBOUNDED : frames[function] + frame.deepest;
+        states[function] = STATE_DONE;
+        stack.pop_back();
+    }
+}
+
+
+size_t StackAnalysis::size() const {
+    return begins.size();
+}
+
+
+const char * StackAnalysis::get_name(size_t function) const {
+    return names[function].c_str();
+}
+
+
+uint32_t StackAnalysis::get_frame(size_t function) const {
+    return frames[function];
+}
+
+
+bool StackAnalysis::is_leaf(size_t function) const {
+    return leaves[function];
+}
+
+
+bool StackAnalysis::is_entry(size_t function) const {
+    return entries[function];
+}
+
+
+bool StackAnalysis::has_indirect_calls(size_t function) const {
+    return indirect[function];
+}
+
+
+uint32_t StackAnalysis::get_max_depth(size_t function) const {
+    return depths[function];
+}
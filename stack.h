@@ -0,0 +1,54 @@
+#ifndef STACK_H
+#define STACK_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "riscvutil.h"
+#include "elfutil.h"
+
+#define STACK_UNBOUNDED UINT32_MAX
+
+
+// Worst-case stack usage per function. Fed with every instruction of .text in
+// address order during the label pass; each function start gets its prologue
+// frame size (the first addi sp, sp, -N), a leaf flag and its direct call
+// edges, all kept in flat arrays indexed by function. FUNC symbols sharing a
+// start are one function listed under every alias.
+class StackAnalysis {
+public:
+    void add_function(Elf32_Addr begin, Elf32_Word size, const char *name);
+    void start();
+    void visit(Elf32_Addr addr, Instruction instruction);
+    void finish(Elf32_Addr entry);
+
+    size_t size() const;
+    const char * get_name(size_t function) const;
+    uint32_t get_frame(size_t function) const;
+    bool is_leaf(size_t function) const;
+    bool is_entry(size_t function) const;
+    bool has_indirect_calls(size_t function) const;
+    uint32_t get_max_depth(size_t function) const;
+private:
+    size_t find_function(Elf32_Addr addr) const;
+    void compute_depth(size_t root);
+
+    std::vector<Elf32_Addr> begins;
+    std::vector<Elf32_Addr> ends;
+    std::vector<std::string> names;
+    std::vector<uint32_t> frames;
+    std::vector<uint8_t> has_frame;
+    std::vector<uint8_t> leaves;
+    std::vector<uint8_t> entries;
+    std::vector<uint8_t> indirect;
+    std::vector<uint32_t> depths;
+    std::vector<uint8_t> states;
+    // call edges as (caller, target address), then grouped by caller
+    std::vector<std::pair<uint32_t, Elf32_Addr>> calls;
+    std::vector<uint32_t> edge_begins;
+    std::vector<uint32_t> edges;
+    size_t cursor = 0;
+};
+
+#endif
@@ -0,0 +1,66 @@
+#include <algorithm>
+
+#include "symindex.h"
+
+
+void SymbolIndex::build(std::vector<SymbolRange> ranges) {
+    std::stable_sort(ranges.begin(), ranges.end(), [](const SymbolRange &a, const SymbolRange &b) {
+        return a.value < b.value;
+    });
+    this->ranges = std::move(ranges);
+    keys.assign(this->ranges.size() + 1, 0);
+    ranks.assign(this->ranges.size() + 1, 0);
+    fill(1, 0);
+    enclosing.assign(this->ranges.size(), SYMBOL_NO_RANGE);
+    std::vector<uint32_t> open;
+    for (size_t i = 0; i < this->ranges.size(); i++) {
+        const SymbolRange &range = this->ranges[i];
+        while (!open.empty() && this->ranges[open.back()].value + (uint64_t) this->ranges[open.back()].size <= range.value) {
+            open.pop_back();
+        }
+        if (!open.empty()) {
+            enclosing[i] = open.back();
+        }
+        if (range.size != 0) {
+            open.push_back(i);
+        }
+    }
+}
+
+
+size_t SymbolIndex::fill(size_t node, size_t next) {
+    if (node < keys.size()) {
+        next = fill(2 * node, next);
+        keys[node] = ranges[next].value;
+        ranks[node] = next;
+        next = fill(2 * node + 1, next + 1);
+    }
+    return next;
+}
+
+
+const SymbolRange * SymbolIndex::find(Elf32_Addr addr) const {
+    size_t count = keys.size() - 1;
+    size_t node = 1;
+    while (node <= count) {
+        __builtin_prefetch(keys.data() + 16 * node);
+        node = 2 * node + (keys[node] <= addr);
+    }
+    // Drop the trailing right turns: what is left is the first key > addr
+    node >>= __builtin_ffsll(~node);
+    size_t upper = node == 0 ? count : ranks[node];
+    if (upper == 0) {
+        return nullptr;
+    }
+    for (uint32_t i = upper - 1; i != SYMBOL_NO_RANGE; i = enclosing[i]) {
+        if (addr - ranges[i].value < ranges[i].size) {
+            return &ranges[i];
+        }
+    }
+    return nullptr;
+}
+
+
+bool SymbolIndex::empty() const {
+    return ranges.empty();
+}
@@ -0,0 +1,41 @@
+#ifndef SYMINDEX_H
+#define SYMINDEX_H
+
+#include <cstdint>
+#include <vector>
+
+#include "elfutil.h"
+
+#define SYMBOL_NO_RANGE UINT32_MAX
+
+
+struct SymbolRange {
+    Elf32_Addr value;
+    Elf32_Word size;
+    const char *name;
+};
+
+
+// Interval lookup over sized symbols. Start addresses are stored in
+// Eytzinger (BFS) order so the search touches one cache line per few levels
+// and has no unpredictable branches. An address past the end of the nearest
+// range below it falls back to the ranges that were still open where that one
+// starts, so a nested symbol doesn't hide the one around it. Read-only after
+// build.
+class SymbolIndex {
+public:
+    void build(std::vector<SymbolRange> ranges);
+    const SymbolRange * find(Elf32_Addr addr) const;
+    bool empty() const;
+private:
+    size_t fill(size_t node, size_t next);
+
+    std::vector<SymbolRange> ranges;
+    std::vector<Elf32_Addr> keys;
+    std::vector<uint32_t> ranks;
+    // Latest starting range still open at each range's start, SYMBOL_NO_RANGE
+    // if none
+    std::vector<uint32_t> enclosing;
+};
+
+#endif
@@ -0,0 +1,306 @@
+// Scaling benchmark: generates synthetic images with gen_elf, runs disasm over
+// each of them with every requested thread count and writes one JSON object
+// per run (wall time, instructions per second, peak RSS) to stdout and
+// optionally to a report file. Runs breaking a threshold are marked with
+// "pass": false and make the exit status 1.
+//
+// Build: g++ -O2 -std=c++17 test/benchmark.cpp -o benchmark
+// Usage: benchmark [options]
+//   --disasm PATH            disassembler binary (./disasm)
+//   --generator PATH         gen_elf binary (./gen_elf)
+//   --dir DIR                where images are generated (/tmp)
+//   --sizes LIST             .text sizes, e.g. 1M,256M,2G (1M,16M)
+//   --symbols N              symbols per image (one per 64 instructions)
+//   --branch-density P       share of branches and calls (0.15)
+//   --threads LIST           thread counts (1 and all cores)
+//   --args "ARGS"            extra disasm options, split on spaces
+//   --output PATH            listing output (/dev/null)
+//   --repeat N               runs per configuration, the fastest is kept (1)
+//   --report FILE            append the JSON lines to FILE too
+//   --min-ips N              fail runs below N instructions per second
+//   --max-rss-overhead MB    fail runs whose peak RSS exceeds the image size by more
+//   --min-speedup X          fail images whose run with the most threads is
+//                            less than X times faster than the one with the fewest
+//   --keep                   keep the generated images
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+
+struct RunResult {
+    double seconds;
+    long max_rss_kb;
+    int exit_status;
+};
+
+
+static std::vector<std::string> split(const std::string &text, char separator) {
+    std::vector<std::string> parts;
+    size_t begin = 0;
+    while (begin <= text.size()) {
+        size_t end = text.find(separator, begin);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        if (end > begin) {
+            parts.push_back(text.substr(begin, end - begin));
+        }
+        begin = end + 1;
+    }
+    return parts;
+}
+
+
+static uint64_t parse_size(const std::string &text) {
+    char *end;
+    uint64_t size = strtoull(text.c_str(), &end, 10);
+    switch (*end) {
+        case 'k':
+        case 'K':
+            return size << 10;
+        case 'm':
+        case 'M':
+            return size << 20;
+        case 'g':
+        case 'G':
+            return size << 30;
+        default:
+            return size;
+    }
+}
+
+
+static std::string escape(const std::string &text) {
+    std::string result;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+        }
+        result += c;
+    }
+    return result;
+}
+
+
+static double now() {
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+
+// Peak RSS comes from the child's rusage, so no external time(1) is needed
+static bool run_command(const std::vector<std::string> &args, RunResult &result) {
+    std::vector<char *> argv;
+    for (const std::string &arg : args) {
+        argv.push_back((char *) arg.c_str());
+    }
+    argv.push_back(nullptr);
+    double start = now();
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("Couldn't fork");
+        return false;
+    }
+    if (pid == 0) {
+        execv(argv[0], argv.data());
+        perror(argv[0]);
+        _exit(127);
+    }
+    int status;
+    rusage usage;
+    if (wait4(pid, &status, 0, &usage) == -1) {
+        perror("Couldn't wait");
+        return false;
+    }
+    result.seconds = now() - start;
+    result.max_rss_kb = usage.ru_maxrss;
+    result.exit_status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    return true;
+}
+
+
+static void report(FILE *report_file, const std::string &line) {
+    printf("%s\n", line.c_str());
+    fflush(stdout);
+    if (report_file != nullptr) {
+        fprintf(report_file, "%s\n", line.c_str());
+        fflush(report_file);
+    }
+}
+
+
+int main(int argc, char *argv[]) {
+    std::string disasm = "./disasm";
+    std::string generator = "./gen_elf";
+    std::string dir = "/tmp";
+    std::string sizes = "1M,16M";
+    std::string symbols;
+    std::string branch_density = "0.15";
+    std::string threads = "1," + std::to_string(std::max(1u, std::thread::hardware_concurrency()));
+    std::string extra_args;
+    std::string output = "/dev/null";
+    int repeat = 1;
+    const char *report_name = nullptr;
+    double min_ips = 0;
+    double max_rss_overhead_mb = -1;
+    double min_speedup = 0;
+    bool keep = false;
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        if (option == "--keep") {
+            keep = true;
+            continue;
+        }
+        if (i + 1 == argc) {
+            fprintf(stderr, "Missing value for %s\n", argv[i]);
+            return 2;
+        }
+        const char *value = argv[++i];
+        if (option == "--disasm") {
+            disasm = value;
+        }
+        else if (option == "--generator") {
+            generator = value;
+        }
+        else if (option == "--dir") {
+            dir = value;
+        }
+        else if (option == "--sizes") {
+            sizes = value;
+        }
+        else if (option == "--symbols") {
+            symbols = value;
+        }
+        else if (option == "--branch-density") {
+            branch_density = value;
+        }
+        else if (option == "--threads") {
+            threads = value;
+        }
+        else if (option == "--args") {
+            extra_args = value;
+        }
+        else if (option == "--output") {
+            output = value;
+        }
+        else if (option == "--repeat") {
+            repeat = std::max(1, atoi(value));
+        }
+        else if (option == "--report") {
+            report_name = value;
+        }
+        else if (option == "--min-ips") {
+            min_ips = atof(value);
+        }
+        else if (option == "--max-rss-overhead") {
+            max_rss_overhead_mb = atof(value);
+        }
+        else if (option == "--min-speedup") {
+            min_speedup = atof(value);
+        }
+        else {
+            fprintf(stderr, "Unknown option %s\n", argv[i - 1]);
+            return 2;
+        }
+    }
+    FILE *report_file = nullptr;
+    if (report_name != nullptr && (report_file = fopen(report_name, "a")) == nullptr) {
+        perror("Couldn't open report");
+        return 2;
+    }
+    std::vector<int> thread_counts;
+    for (const std::string &count : split(threads, ',')) {
+        thread_counts.push_back(std::max(1, atoi(count.c_str())));
+    }
+    std::sort(thread_counts.begin(), thread_counts.end());
+    thread_counts.erase(std::unique(thread_counts.begin(), thread_counts.end()), thread_counts.end());
+
+    bool passed = true;
+    char line[1024];
+    for (const std::string &size : split(sizes, ',')) {
+        std::string image = dir + "/disasm_bench_" + size + ".elf";
+        std::vector<std::string> generate = {generator, image, size, "--branch-density", branch_density};
+        if (!symbols.empty()) {
+            generate.push_back("--symbols");
+            generate.push_back(symbols);
+        }
+        RunResult result;
+        struct stat image_stat;
+        if (!run_command(generate, result) || result.exit_status != 0 || stat(image.c_str(), &image_stat) != 0) {
+            fprintf(stderr, "Couldn't generate %s\n", image.c_str());
+            passed = false;
+            continue;
+        }
+        uint64_t instructions = parse_size(size) / 4;
+        double fewest_threads_ips = 0;
+        double most_threads_ips = 0;
+        for (int thread_count : thread_counts) {
+            std::vector<std::string> command = {disasm, "--threads", std::to_string(thread_count)};
+            for (const std::string &arg : split(extra_args, ' ')) {
+                command.push_back(arg);
+            }
+            command.push_back(image);
+            command.push_back(output);
+            RunResult best = {0, 0, 0};
+            for (int run = 0; run < repeat; run++) {
+                if (!run_command(command, result)) {
+                    return 2;
+                }
+                best.seconds = run == 0 ? result.seconds : std::min(best.seconds, result.seconds);
+                best.max_rss_kb = std::max(best.max_rss_kb, result.max_rss_kb);
+                best.exit_status = std::max(best.exit_status, result.exit_status);
+            }
+            double ips = instructions / std::max(best.seconds, 1e-9);
+            // The input is mapped, so its pages count towards RSS
+            long overhead_kb = std::max<long>(0, best.max_rss_kb - (long) (image_stat.st_size / 1024));
+            std::string failures;
+            if (best.exit_status != 0) {
+                failures += "exit_status,";
+            }
+            if (ips < min_ips) {
+                failures += "min_ips,";
+            }
+            if (max_rss_overhead_mb >= 0 && overhead_kb > max_rss_overhead_mb * 1024) {
+                failures += "max_rss_overhead,";
+            }
+            passed = passed && failures.empty();
+            if (thread_count == thread_counts.front()) {
+                fewest_threads_ips = ips;
+            }
+            most_threads_ips = ips;
+            snprintf(line, sizeof(line), "{\"image\": \"%s\", \"file_bytes\": %lld, \"instructions\": %llu, \"threads\": %d, \"args\": \"%s\", "
+                    "\"seconds\": %.6f, \"instructions_per_second\": %.0f, \"max_rss_kb\": %ld, \"rss_overhead_kb\": %ld, \"exit_status\": %d, \"pass\": %s, \"failures\": \"%.*s\"}",
+                    escape(image).c_str(), (long long) image_stat.st_size, (unsigned long long) instructions, thread_count, escape(extra_args).c_str(),
+                    best.seconds, ips, best.max_rss_kb, overhead_kb, best.exit_status, failures.empty() ? "true" : "false",
+                    (int) (failures.empty() ? 0 : failures.size() - 1), failures.c_str());
+            report(report_file, line);
+        }
+        if (thread_counts.size() > 1 && min_speedup > 0) {
+            double speedup = most_threads_ips / std::max(fewest_threads_ips, 1e-9);
+            snprintf(line, sizeof(line), "{\"image\": \"%s\", \"check\": \"speedup\", \"threads\": [%d, %d], \"speedup\": %.3f, \"min_speedup\": %.3f, \"pass\": %s}",
+                    escape(image).c_str(), thread_counts.front(), thread_counts.back(), speedup, min_speedup, speedup >= min_speedup ? "true" : "false");
+            report(report_file, line);
+            passed = passed && speedup >= min_speedup;
+        }
+        if (!keep) {
+            unlink(image.c_str());
+        }
+    }
+    if (report_file != nullptr) {
+        fclose(report_file);
+    }
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,83 @@
+#!/bin/sh
+# Runs riscv objdump -d and disasm --objdump over the same images, diffs the
+# listings and reports instructions per second for both tools. Without a
+# RISC-V objdump, test_elf is diffed against the checked in objdump_disasm.txt.
+#
+# Usage: test/compare_objdump.sh DISASM [ELF...]
+# OBJDUMP selects the objdump binary, REPEAT the number of timed runs.
+
+DISASM=${1:-./disasm}
+[ $# -gt 0 ] && shift
+[ $# -eq 0 ] && set -- "$(dirname "$0")/test_elf"
+REPEAT=${REPEAT:-10}
+
+if [ -z "$OBJDUMP" ]; then
+    for candidate in riscv64-unknown-elf-objdump riscv32-unknown-elf-objdump riscv64-linux-gnu-objdump; do
+        if command -v "$candidate" > /dev/null 2>&1; then
+            OBJDUMP=$candidate
+            break
+        fi
+    done
+fi
+if [ ! -x "$DISASM" ]; then
+    echo "disasm binary $DISASM not found"
+    exit 1
+fi
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+if [ -z "$OBJDUMP" ] || ! command -v "$OBJDUMP" > /dev/null 2>&1; then
+    # objdump_disasm.txt is the reviewed listing of test_elf, with aliases
+    echo "RISC-V objdump not found, comparing test_elf with objdump_disasm.txt"
+    "$DISASM" --objdump "$(dirname "$0")/test_elf" "$TMP/disasm.txt"
+    sed '/file format/d' "$(dirname "$0")/objdump_disasm.txt" > "$TMP/golden.norm"
+    sed '/file format/d' "$TMP/disasm.txt" > "$TMP/disasm.norm"
+    diff -u "$TMP/golden.norm" "$TMP/disasm.norm"
+    exit
+fi
+
+now() {
+    date +%s%N
+}
+
+status=0
+for elf in "$@"; do
+    "$DISASM" --histogram "$elf" "$TMP/histogram.txt"
+    instructions=$(sed -n 's/^Instructions: //p' "$TMP/histogram.txt")
+
+    start=$(now)
+    i=0
+    while [ $i -lt "$REPEAT" ]; do
+        "$OBJDUMP" -d "$elf" > "$TMP/objdump.txt"
+        i=$((i + 1))
+    done
+    objdump_time=$(($(now) - start))
+
+    start=$(now)
+    i=0
+    while [ $i -lt "$REPEAT" ]; do
+        "$DISASM" --objdump "$elf" "$TMP/disasm.txt"
+        i=$((i + 1))
+    done
+    disasm_time=$(($(now) - start))
+
+    # objdump stops at the end of .text, drop trailing blank lines on both sides
+    sed -e :a -e '/^\n*$/{$d;N;ba' -e '}' "$TMP/objdump.txt" > "$TMP/objdump.norm"
+    sed -e :a -e '/^\n*$/{$d;N;ba' -e '}' "$TMP/disasm.txt" > "$TMP/disasm.norm"
+    if diff -u "$TMP/objdump.norm" "$TMP/disasm.norm" > "$TMP/diff.txt"; then
+        result="identical"
+    else
+        result="$(grep -c '^[-+][^-+]' "$TMP/diff.txt") differing lines"
+        cat "$TMP/diff.txt"
+        status=1
+    fi
+    awk -v elf="$elf" -v n="$instructions" -v r="$REPEAT" -v o="$objdump_time" -v d="$disasm_time" -v res="$result" 'BEGIN {
+        o_ips = n * r / (o / 1e9)
+        d_ips = n * r / (d / 1e9)
+        printf "%s: %d instructions, %s\n", elf, n, res
+        printf "  objdump: %.0f instructions/s\n", o_ips
+        printf "  disasm:  %.0f instructions/s (%.2fx)\n", d_ips, d_ips / o_ips
+    }'
+done
+exit $status
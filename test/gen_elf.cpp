@@ -0,0 +1,280 @@
+// Writes a synthetic RV32IM executable for scaling tests: a .text of the
+// requested size split evenly into FUNC symbols, each with a prologue, a body
+// of random ALU, memory, branch and call instructions and an epilogue.
+// The output is deterministic for a given seed.
+//
+// Build: g++ -O2 -std=c++17 test/gen_elf.cpp -o gen_elf
+// Usage: gen_elf OUTPUT SIZE [--symbols N] [--branch-density P] [--seed S]
+// SIZE is the .text size in bytes and takes K, M and G suffixes.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../riscvutil.h"
+#include "../elfutil.h"
+
+#define TEXT_OFFSET 0x1000
+#define TEXT_ADDR 0x11000
+#define ET_EXEC 2
+#define BUFFER_WORDS (1 << 20)
+#define MIN_FUNCTION_WORDS 8
+// Calls go at most this many functions away, well inside jal's +-1 MiB
+#define CALL_DISTANCE 64
+
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ull;
+
+
+static uint64_t next_random() {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545f4914f6cdd1dull;
+}
+
+
+static uint32_t random_below(uint32_t bound) {
+    return (uint32_t) ((next_random() >> 32) * bound >> 32);
+}
+
+
+static uint32_t encode_r(uint32_t funct7, uint32_t rs2, uint32_t rs1, uint32_t funct3, uint32_t rd, uint32_t opcode) {
+    return funct7 << 25 | rs2 << 20 | rs1 << 15 | funct3 << 12 | rd << 7 | opcode;
+}
+
+
+static uint32_t encode_i(int32_t immediate, uint32_t rs1, uint32_t funct3, uint32_t rd, uint32_t opcode) {
+    return ((uint32_t) immediate & 0xfff) << 20 | rs1 << 15 | funct3 << 12 | rd << 7 | opcode;
+}
+
+
+static uint32_t encode_s(int32_t immediate, uint32_t rs2, uint32_t rs1, uint32_t funct3) {
+    uint32_t imm = (uint32_t) immediate & 0xfff;
+    return (imm >> 5) << 25 | rs2 << 20 | rs1 << 15 | funct3 << 12 | (imm & 0x1f) << 7 | 0b0100011;
+}
+
+
+static uint32_t encode_b(int32_t offset, uint32_t rs2, uint32_t rs1, uint32_t funct3) {
+    uint32_t imm = (uint32_t) offset;
+    return ((imm >> 12) & 1) << 31 | ((imm >> 5) & 0x3f) << 25 | rs2 << 20 | rs1 << 15 | funct3 << 12 | ((imm >> 1) & 0xf) << 8 | ((imm >> 11) & 1) << 7 | 0b1100011;
+}
+
+
+static uint32_t encode_j(int32_t offset, uint32_t rd) {
+    uint32_t imm = (uint32_t) offset;
+    return ((imm >> 20) & 1) << 31 | ((imm >> 1) & 0x3ff) << 21 | ((imm >> 11) & 1) << 20 | ((imm >> 12) & 0xff) << 12 | rd << 7 | 0b1101111;
+}
+
+
+static uint32_t random_register() {
+    // t0 and up, leaving zero, ra, sp, gp and tp alone
+    return 5 + random_below(27);
+}
+
+
+static uint32_t random_alu_or_memory() {
+    uint32_t rd = random_register();
+    uint32_t rs1 = random_register();
+    uint32_t rs2 = random_register();
+    switch (random_below(8)) {
+        case 0:
+            return encode_r(0, rs2, rs1, 0b000, rd, 0b0110011);           // add
+        case 1:
+            return encode_r(0b0100000, rs2, rs1, 0b000, rd, 0b0110011);   // sub
+        case 2:
+            return encode_r(0, rs2, rs1, 0b100, rd, 0b0110011);           // xor
+        case 3:
+            return encode_r(1, rs2, rs1, 0b000, rd, 0b0110011);           // mul
+        case 4:
+            return encode_i((random_below(512) - 256) * 4, 2, 0b010, rd, 0b0000011);  // lw rd, imm(sp)
+        case 5:
+            return encode_s((random_below(512) - 256) * 4, rs2, 2, 0b010);          // sw rs2, imm(sp)
+        case 6:
+            return (random_below(1 << 20) << 12) | rd << 7 | 0b0110111;              // lui
+        default:
+            return encode_i(random_below(4096) - 2048, rs1, 0b000, rd, 0b0010011);   // addi
+    }
+}
+
+
+static uint64_t parse_size(const char *text) {
+    char *end;
+    uint64_t size = strtoull(text, &end, 10);
+    switch (*end) {
+        case 'k':
+        case 'K':
+            return size << 10;
+        case 'm':
+        case 'M':
+            return size << 20;
+        case 'g':
+        case 'G':
+            return size << 30;
+        default:
+            return size;
+    }
+}
+
+
+static bool write_all(FILE *file, const void *data, size_t size) {
+    return fwrite(data, 1, size, file) == size;
+}
+
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: gen_elf OUTPUT SIZE [--symbols N] [--branch-density P] [--seed S]\n");
+        return 1;
+    }
+    uint64_t text_size = parse_size(argv[2]) / ILEN_BYTE * ILEN_BYTE;
+    uint64_t symbols = 0;
+    double branch_density = 0.15;
+    for (int i = 3; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--symbols") == 0) {
+            symbols = strtoull(argv[i + 1], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--branch-density") == 0) {
+            branch_density = atof(argv[i + 1]);
+        }
+        else if (strcmp(argv[i], "--seed") == 0) {
+            rng_state = strtoull(argv[i + 1], nullptr, 0) | 1;
+        }
+        else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    uint64_t words = text_size / ILEN_BYTE;
+    if (symbols == 0) {
+        symbols = words / 64 + 1;
+    }
+    if (words < MIN_FUNCTION_WORDS || words / symbols < MIN_FUNCTION_WORDS) {
+        fprintf(stderr, "Need at least %d instructions per symbol\n", MIN_FUNCTION_WORDS);
+        return 1;
+    }
+    // ELF32 offsets and addresses are 32 bits wide
+    uint64_t tables_size = (symbols + 1) * (sizeof(Elf32_Sym) + 16) + 4096;
+    if (TEXT_ADDR + text_size + tables_size > UINT32_MAX) {
+        fprintf(stderr, "Image too large for ELF32\n");
+        return 1;
+    }
+    FILE *file = fopen(argv[1], "wb");
+    if (file == nullptr) {
+        perror("Couldn't open output");
+        return 1;
+    }
+
+    uint64_t words_per_function = words / symbols;
+    std::vector<uint32_t> buffer;
+    buffer.reserve(BUFFER_WORDS);
+    std::vector<char> padding(TEXT_OFFSET - sizeof(Elf32_Ehdr), 0);
+    bool ok = fseek(file, sizeof(Elf32_Ehdr), SEEK_SET) == 0 && write_all(file, padding.data(), padding.size());
+    for (uint64_t function = 0; function < symbols && ok; function++) {
+        uint64_t begin = function * words_per_function;
+        uint64_t end = function + 1 == symbols ? words : begin + words_per_function;
+        uint64_t body_begin = begin + 2;
+        uint64_t body_end = end - 3;
+        buffer.push_back(encode_i(-16, 2, 0b000, 2, 0b0010011));   // addi sp, sp, -16
+        buffer.push_back(encode_s(12, 1, 2, 0b010));                // sw ra, 12(sp)
+        for (uint64_t i = body_begin; i < body_end; i++) {
+            if (next_random() % 1000000 >= branch_density * 1000000) {
+                buffer.push_back(random_alu_or_memory());
+            }
+            else if (random_below(4) == 0) {
+                uint64_t distance = random_below(2 * CALL_DISTANCE + 1);
+                uint64_t callee = function + distance >= CALL_DISTANCE ? function + distance - CALL_DISTANCE : 0;
+                callee = callee < symbols ? callee : function;
+                int64_t offset = ((int64_t) (callee * words_per_function) - (int64_t) i) * ILEN_BYTE;
+                if (offset >= -(1 << 20) && offset < (1 << 20)) {
+                    buffer.push_back(encode_j((int32_t) offset, 1));    // jal ra, callee
+                }
+                else {
+                    buffer.push_back(random_alu_or_memory());
+                }
+            }
+            else {
+                // mostly short backward branches, like loops
+                int64_t target = (int64_t) i + (int64_t) random_below(96) - 64;
+                target = std::max<int64_t>(body_begin, std::min<int64_t>(target, body_end - 1));
+                static const uint32_t FUNCT3[] = {0b000, 0b001, 0b100, 0b101, 0b110, 0b111};
+                buffer.push_back(encode_b((int32_t) (target - (int64_t) i) * ILEN_BYTE, random_register(), random_register(), FUNCT3[random_below(6)]));
+            }
+            if (buffer.size() == BUFFER_WORDS) {
+                ok = ok && write_all(file, buffer.data(), buffer.size() * ILEN_BYTE);
+                buffer.clear();
+            }
+        }
+        buffer.push_back(encode_i(12, 2, 0b010, 1, 0b0000011));    // lw ra, 12(sp)
+        buffer.push_back(encode_i(16, 2, 0b000, 2, 0b0010011));    // addi sp, sp, 16
+        buffer.push_back(encode_i(0, 1, 0b000, 0, 0b1100111));     // jalr zero, 0(ra)
+        if (buffer.size() >= BUFFER_WORDS - 8) {
+            ok = ok && write_all(file, buffer.data(), buffer.size() * ILEN_BYTE);
+            buffer.clear();
+        }
+    }
+    ok = ok && write_all(file, buffer.data(), buffer.size() * ILEN_BYTE);
+
+    std::string strtab(1, '\0');
+    std::vector<Elf32_Sym> symtab(1);
+    memset(&symtab[0], 0, sizeof(Elf32_Sym));
+    for (uint64_t function = 0; function < symbols; function++) {
+        uint64_t begin = function * words_per_function;
+        uint64_t end = function + 1 == symbols ? words : begin + words_per_function;
+        Elf32_Sym sym;
+        sym.st_name = strtab.size();
+        sym.st_value = TEXT_ADDR + begin * ILEN_BYTE;
+        sym.st_size = (end - begin) * ILEN_BYTE;
+        sym.st_info = (STB_GLOBAL << 4) | STT_FUNC;
+        sym.st_other = STV_DEFAULT;
+        sym.st_shndx = 1;
+        symtab.push_back(sym);
+        strtab += "f" + std::to_string(function);
+        strtab += '\0';
+    }
+    const char shstrtab[] = "\0.text\0.symtab\0.strtab\0.shstrtab";
+    Elf32_Off symtab_offset = TEXT_OFFSET + text_size;
+    Elf32_Off strtab_offset = symtab_offset + symtab.size() * sizeof(Elf32_Sym);
+    Elf32_Off shstrtab_offset = strtab_offset + strtab.size();
+    Elf32_Off section_headers_offset = (shstrtab_offset + sizeof(shstrtab) + 3) / 4 * 4;
+    ok = ok && write_all(file, symtab.data(), symtab.size() * sizeof(Elf32_Sym));
+    ok = ok && write_all(file, strtab.data(), strtab.size());
+    ok = ok && write_all(file, shstrtab, sizeof(shstrtab));
+    ok = ok && write_all(file, "\0\0\0", section_headers_offset - shstrtab_offset - sizeof(shstrtab));
+
+    Elf32_Shdr sections[5];
+    memset(sections, 0, sizeof(sections));
+    sections[1] = {1, SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, TEXT_ADDR, TEXT_OFFSET, (Elf32_Word) text_size, 0, 0, 4, 0};
+    sections[2] = {7, SHT_SYMTAB, 0, 0, symtab_offset, (Elf32_Word) (symtab.size() * sizeof(Elf32_Sym)), 3, 1, 4, sizeof(Elf32_Sym)};
+    sections[3] = {15, SHT_STRTAB, 0, 0, strtab_offset, (Elf32_Word) strtab.size(), 0, 0, 1, 0};
+    sections[4] = {23, SHT_STRTAB, 0, 0, shstrtab_offset, sizeof(shstrtab), 0, 0, 1, 0};
+    ok = ok && write_all(file, sections, sizeof(sections));
+
+    Elf32_Ehdr header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.e_ident, "\x7f" "ELF", 4);
+    header.e_ident[EI_CLASS] = ELFCLASS32;
+    header.e_ident[EI_DATA] = ELFDATA2LSB;
+    header.e_ident[EI_VERSION] = EV_CURRENT;
+    header.e_type = ET_EXEC;
+    header.e_machine = EM_RISCV;
+    header.e_version = EV_CURRENT;
+    // disasm takes the entry point as the start of .text
+    header.e_entry = TEXT_ADDR;
+    header.e_shoff = section_headers_offset;
+    header.e_ehsize = sizeof(Elf32_Ehdr);
+    header.e_shentsize = sizeof(Elf32_Shdr);
+    header.e_shnum = 5;
+    header.e_shstrndx = 4;
+    ok = ok && fseek(file, 0, SEEK_SET) == 0 && write_all(file, &header, sizeof(header));
+    if (fclose(file) != 0 || !ok) {
+        perror("Couldn't write output");
+        return 1;
+    }
+    printf("%s: %llu instructions, %llu symbols\n", argv[1], (unsigned long long) words, (unsigned long long) symbols);
+    return 0;
+}
@@ -0,0 +1,140 @@
+#include <thread>
+
+#include "traversal.h"
+
+
+Traversal::Traversal(const char *code, Elf32_Addr base, Elf32_Word size, std::function<bool(Instruction)> is_valid)
+    : code(code), base(base), count(size / ILEN_BYTE), is_valid(is_valid), visited(new std::atomic<uint64_t>[count / 64 + 1]) {
+    for (Elf32_Word i = 0; i < count / 64 + 1; i++) {
+        visited[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+
+bool Traversal::is_reachable(Elf32_Addr addr) const {
+    Elf32_Word index = (addr - base) / ILEN_BYTE;
+    if (addr < base || index >= count) {
+        return false;
+    }
+    return (visited[index / 64].load(std::memory_order_relaxed) >> (index % 64)) & 1;
+}
+
+
+bool Traversal::claim(Elf32_Word index) {
+    uint64_t bit = (uint64_t) 1 << (index % 64);
+    return (visited[index / 64].fetch_or(bit, std::memory_order_relaxed) & bit) == 0;
+}
+
+
+void Traversal::push(unsigned worker, Elf32_Addr addr) {
+    Elf32_Word index = (addr - base) / ILEN_BYTE;
+    if (addr < base || (addr - base) % ILEN_BYTE != 0 || index >= count || is_reachable(addr)) {
+        return;
+    }
+    pending.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(queues[worker]->mutex);
+        queues[worker]->items.push_back(index);
+    }
+    queued.fetch_add(1);
+    // Either this sees the sleeper or the sleeper sees queued, taking the
+    // mutex makes sure it is waiting before the notification
+    if (idle.load() > 0) {
+        std::lock_guard<std::mutex> lock(idle_mutex);
+        work_ready.notify_one();
+    }
+}
+
+
+bool Traversal::pop(unsigned worker, Elf32_Word &index) {
+    {
+        WorkQueue &own = *queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.items.empty()) {
+            index = own.items.back();
+            own.items.pop_back();
+            queued.fetch_sub(1);
+            return true;
+        }
+    }
+    for (size_t i = 1; i < queues.size(); i++) {
+        WorkQueue &victim = *queues[(worker + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.items.empty()) {
+            index = victim.items.front();
+            victim.items.pop_front();
+            queued.fetch_sub(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void Traversal::walk(unsigned worker, Elf32_Word index) {
+    for (; index < count; index++) {
+        Elf32_Addr addr = base + index * ILEN_BYTE;
+        Instruction instruction = *((const Instruction *) (code + index * ILEN_BYTE));
+        // An undecodable word ends the run and stays data
+        if (!is_valid(instruction) || !claim(index)) {
+            return;
+        }
+        Opcode opcode = instruction & 0b1111111;
+        if (opcode == JAL) {
+            push(worker, addr + get_j_immediate(instruction));
+            if (get_rd(instruction) == 0) {
+                return;
+            }
+        }
+        else if (opcode == BRANCH) {
+            push(worker, addr + get_b_immediate(instruction));
+        }
+        else if (opcode == JALR && get_rd(instruction) == 0) {
+            return;
+        }
+    }
+}
+
+
+void Traversal::work(unsigned worker) {
+    while (true) {
+        Elf32_Word index;
+        if (pop(worker, index)) {
+            walk(worker, index);
+            if (pending.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lock(idle_mutex);
+                work_ready.notify_all();
+            }
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(idle_mutex);
+        idle.fetch_add(1);
+        work_ready.wait(lock, [this]() {
+            return queued.load() > 0 || pending.load() == 0;
+        });
+        idle.fetch_sub(1);
+        if (pending.load() == 0) {
+            return;
+        }
+    }
+}
+
+
+void Traversal::run(const std::vector<Elf32_Addr> &seeds, unsigned threads) {
+    threads = threads == 0 ? 1 : threads;
+    queues.clear();
+    for (unsigned i = 0; i < threads; i++) {
+        queues.emplace_back(new WorkQueue);
+    }
+    for (size_t i = 0; i < seeds.size(); i++) {
+        push(i % threads, seeds[i]);
+    }
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < threads; i++) {
+        workers.emplace_back(&Traversal::work, this, i);
+    }
+    work(0);
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
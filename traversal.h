@@ -0,0 +1,53 @@
+#ifndef TRAVERSAL_H
+#define TRAVERSAL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "riscvutil.h"
+#include "elfutil.h"
+
+
+// Recursive traversal of .text: starting from the seed addresses, follows
+// fall-through, jal and branch targets and marks every reachable instruction
+// in an atomic bitmap. Each worker owns a deque and steals from the others
+// when its own one runs dry; with nothing to steal it sleeps until work is
+// pushed or the traversal ends.
+class Traversal {
+public:
+    Traversal(const char *code, Elf32_Addr base, Elf32_Word size, std::function<bool(Instruction)> is_valid);
+    void run(const std::vector<Elf32_Addr> &seeds, unsigned threads);
+    bool is_reachable(Elf32_Addr addr) const;
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<Elf32_Word> items;
+    };
+
+    void push(unsigned worker, Elf32_Addr addr);
+    bool pop(unsigned worker, Elf32_Word &index);
+    bool claim(Elf32_Word index);
+    void walk(unsigned worker, Elf32_Word index);
+    void work(unsigned worker);
+
+    const char *code;
+    Elf32_Addr base;
+    Elf32_Word count;
+    std::function<bool(Instruction)> is_valid;
+    std::unique_ptr<std::atomic<uint64_t>[]> visited;
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    // Addresses pushed and not walked yet, walks in progress included
+    std::atomic<long> pending{0};
+    // Addresses waiting in the deques
+    std::atomic<long> queued{0};
+    std::mutex idle_mutex;
+    std::condition_variable work_ready;
+    std::atomic<unsigned> idle{0};
+};
+
+#endif